@@ -1,3 +1,7 @@
 #!/bin/bash
 
-g++ -Wall -Wextra -pedantic -o SimpleDasherLanguageModel src/main.cpp src/LanguageModelling/PPMLanguageModel.cpp src/Alphabet/AlphabetMap.cpp src/Alphabet/SymbolStream.cpp
+g++ -Wall -Wextra -pedantic -pthread -o SimpleDasherLanguageModel src/main.cpp src/LanguageModelling/PPMLanguageModel.cpp src/LanguageModelling/SuffixArrayLanguageModel.cpp src/Serving/NumaTopology.cpp src/Serving/ReplicatedLanguageModel.cpp src/Alphabet/AlphabetMap.cpp src/Alphabet/SymbolStream.cpp src/Alphabet/TokenMap.cpp
+g++ -Wall -Wextra -pedantic -fPIC -shared -o libDasherLanguageModel.so src/CApi/DasherLanguageModel.cpp src/LanguageModelling/PPMLanguageModel.cpp src/Alphabet/AlphabetMap.cpp src/Alphabet/SymbolStream.cpp src/Alphabet/TokenMap.cpp
+g++ -Wall -Wextra -pedantic -pthread -o DasherLMDaemon src/Daemon/DaemonMain.cpp src/Daemon/Protocol.cpp src/CApi/DasherLanguageModel.cpp src/LanguageModelling/PPMLanguageModel.cpp src/Alphabet/AlphabetMap.cpp src/Alphabet/SymbolStream.cpp src/Alphabet/TokenMap.cpp
+g++ -Wall -Wextra -pedantic -pthread -o DasherLMLoadGenerator src/Daemon/LoadGeneratorMain.cpp src/Daemon/Protocol.cpp
+g++ -Wall -Wextra -pedantic -o DasherLMFuzzer src/Fuzzing/DifferentialFuzzerMain.cpp src/LanguageModelling/PPMLanguageModel.cpp src/LanguageModelling/SuffixArrayLanguageModel.cpp src/Alphabet/AlphabetMap.cpp src/Alphabet/SymbolStream.cpp src/Alphabet/TokenMap.cpp
@@ -8,8 +8,8 @@ using namespace Dasher;
 
 AlphabetMap::AlphabetMap(unsigned int initialTableSize) : hashTable(initialTableSize<<1) {
 	entries.reserve(initialTableSize);
-	// TODO: fix the code so it works if char is signed.
-	const int numChars = std::numeric_limits<char>::max()+1;
+	//indexed by unsigned char, so this also works where char is signed
+	const int numChars = std::numeric_limits<unsigned char>::max()+1;
 	singleChars=new Symbol[numChars];
 	for (int i = 0; i<numChars; i++)
 		singleChars[i]=UNKNOWN_SYMBOL;
@@ -25,7 +25,7 @@ void AlphabetMap::add(const std::string& key, Symbol value) {
 	if (key.length()==1) {
 		//DASHER_ASSERT(singleChars[key[0]]==UNKNOWN_SYMBOL);
 		//DASHER_ASSERT(key[0]!='\r' || paragraphSymbol==UNKNOWN_SYMBOL);
-		singleChars[key[0]]=value;
+		singleChars[static_cast<unsigned char>(key[0])]=value;
 		return;
 	}
 	Entry*& hashEntry = hashTable[hash(key)];
@@ -66,7 +66,7 @@ Symbol AlphabetMap::get(const std::string& key) const {
 }
 
 Symbol AlphabetMap::getSingleChar(char key) const {
-	return singleChars[key];
+	return singleChars[static_cast<unsigned char>(key)];
 }
 
 // A standard hash -- could try and research something specific.
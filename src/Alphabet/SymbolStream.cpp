@@ -27,9 +27,19 @@ Symbol SymbolStream::next(const AlphabetMap* map) {
 	return symbol;
 }
 
-int SymbolStream::findNext() {
+Symbol SymbolStream::next(const TokenMap* map) {
+	int utf8Length = findNext(map->getMaxTokenLength());
+	if (utf8Length==0) return -1; //EOF
+	int matchLength;
+	Symbol symbol = map->getLongestMatch(&buffer[pos], validBufferLength-pos, matchLength);
+	pos+=(matchLength>0) ? matchLength : utf8Length; //unknown symbol, skip one character
+	return symbol;
+}
+
+int SymbolStream::findNext(int lookahead) {
+	if (lookahead<4) lookahead=4; //4 is max length of an UTF-8 char
 	while (true) {
-		if (pos+4>validBufferLength) { //4 is max length of an UTF-8 char
+		if (pos+lookahead>validBufferLength) {
 			//may need more bytes for next char, so...
 			if (pos>0) { //...shift remaining bytes to the beginning of buffer...
 				validBufferLength-=pos; //length of them
@@ -40,7 +50,7 @@ int SymbolStream::findNext() {
 			readMore(); //...and look for more
 		}
 		if (pos==validBufferLength) return 0; //still don't have any chars after attempting to read more, EOF
-		if (int utf8Length = getUTF8Length(buffer[pos])) {
+		if (int utf8Length = getUTF8Length(static_cast<unsigned char>(buffer[pos]))) {
 			if (pos+utf8Length>validBufferLength) {
 				//no more bytes in file (would have tried to read earlier), but not enough for char
 				printf("File ends with incomplete UTF-8 character beginning 0x%x (expecting %i bytes but only %li)\n",
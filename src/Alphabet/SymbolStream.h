@@ -1,5 +1,6 @@
 #include "../Common/DasherTypes.h"
 #include "AlphabetMap.h"
+#include "TokenMap.h"
 #include <iostream>
 
 #ifndef SYMBOL_STREAM_INCLUDED
@@ -13,6 +14,10 @@ namespace Dasher {
 			//to convert unicode characters to symbols.
 			//Returns 0 for unknown symbol (not in map); -1 for EOF; else symbol#.
 			Symbol next(const AlphabetMap* map);
+			//Gets the next symbol in the stream, using the longest token of the specified TokenMap
+			//that the remaining text begins with. If no token matches, one unicode character is
+			//skipped and 0 is returned. Returns -1 for EOF.
+			Symbol next(const TokenMap* map);
 		private:
 			char buffer[1024];
 			off_t pos;
@@ -23,7 +28,8 @@ namespace Dasher {
 			//Leaves 'pos' pointing at beginning of said character.
 			//Returns the number of octets representing the next character, or 0 for EOF
 			//(including where the file ends with an incomplete character)
-			int findNext();
+			//lookahead: number of bytes from 'pos' on that should be in the buffer, unless the file ends earlier
+			int findNext(int lookahead = 4);
 			void readMore();
 			int getUTF8Length(int firstByte);
 	};
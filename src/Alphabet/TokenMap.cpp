@@ -0,0 +1,66 @@
+#include "TokenMap.h"
+#include <stdio.h>
+
+using namespace Dasher;
+
+TokenMap::TokenMap() : maxTokenLength(1), numOfTokens(0) {
+	for (int i = 0; i<256; i++) firstLevel[i]=-1;
+}
+
+void TokenMap::add(const std::string& key, Symbol value) {
+	if (key.empty() || key.length()>MAX_TOKEN_LENGTH) {
+		printf("Token of length %lu not added, must be 1 to %i bytes long\n", key.length(), MAX_TOKEN_LENGTH);
+		return;
+	}
+	unsigned char first = key[0];
+	if (firstLevel[first]==-1) {
+		firstLevel[first]=nodes.size();
+		nodes.push_back(Node(first, -1));
+	}
+	int node = firstLevel[first];
+	for (size_t i = 1; i<key.length(); i++) {
+		unsigned char byte = key[i];
+		int child = findChild(node, byte);
+		if (child==-1) { //prepend a new child; 'nodes' may be reallocated, so don't keep references into it
+			child=nodes.size();
+			nodes.push_back(Node(byte, nodes[node].firstChild));
+			nodes[node].firstChild=child;
+		}
+		node=child;
+	}
+	//DASHER_ASSERT(nodes[node].symbol==0);
+	nodes[node].symbol=value;
+	numOfTokens++;
+	if ((int) key.length()>maxTokenLength) maxTokenLength=key.length();
+}
+
+Symbol TokenMap::getLongestMatch(const char* text, int length, int& matchLength) const {
+	matchLength=0;
+	if (length==0) return 0;
+	Symbol symbol = 0;
+	int node = firstLevel[static_cast<unsigned char>(text[0])];
+	for (int i = 1; node!=-1; i++) {
+		if (nodes[node].symbol!=0) {
+			symbol=nodes[node].symbol;
+			matchLength=i;
+		}
+		if (i==length) break;
+		node=findChild(node, text[i]);
+	}
+	return symbol;
+}
+
+int TokenMap::getMaxTokenLength() const {
+	return maxTokenLength;
+}
+
+int TokenMap::getNumOfTokens() const {
+	return numOfTokens;
+}
+
+int TokenMap::findChild(int node, unsigned char byte) const {
+	for (int child = nodes[node].firstChild; child!=-1; child=nodes[child].nextSibling) {
+		if (nodes[child].byte==byte) return child;
+	}
+	return -1;
+}
@@ -0,0 +1,50 @@
+#ifndef TOKEN_MAP_INCLUDED
+#define TOKEN_MAP_INCLUDED
+
+#include "../Common/DasherTypes.h"
+#include <vector>
+#include <string>
+
+#define MAX_TOKEN_LENGTH 256 //in bytes; must fit into the buffer of SymbolStream
+
+namespace Dasher {
+
+	//Like AlphabetMap, but symbols may stand for several unicode characters (digraphs, combining sequences,
+	//whole words...). Text is split into symbols by greedy longest match, see SymbolStream::next(const TokenMap*).
+	//The tokens are kept in a byte-wise trie; the first byte is looked up in a table, the following ones in
+	//the (short) sibling lists of the trie nodes.
+	class TokenMap {
+		public:
+			TokenMap();
+			//Adds a token to the map
+			//key: text of the token, one or more complete UTF-8 characters and at most MAX_TOKEN_LENGTH bytes;
+			//     must not be present already
+			//value: symbol number to which that text should be mapped
+			void add(const std::string& key, Symbol value);
+			//Returns the symbol of the longest token that 'text' begins with and stores its length in
+			//'matchLength', or returns 0 (unknown symbol) and sets 'matchLength' to 0 if there is none.
+			//length: number of bytes available at 'text'
+			Symbol getLongestMatch(const char* text, int length, int& matchLength) const;
+			int getMaxTokenLength() const;
+			int getNumOfTokens() const;
+		private:
+			class Node {
+				public:
+					Node(unsigned char byte, int nextSibling) :
+							symbol(0), firstChild(-1), nextSibling(nextSibling), byte(byte) {
+						//empty
+					}
+					Symbol symbol; //0 if no token ends here
+					int firstChild; //indices into 'nodes', -1 for none
+					int nextSibling;
+					unsigned char byte;
+			};
+			std::vector<Node> nodes;
+			int firstLevel[256]; //node for each first byte, -1 for none
+			int maxTokenLength;
+			int numOfTokens;
+			int findChild(int node, unsigned char byte) const;
+	};
+}
+
+#endif
@@ -0,0 +1,210 @@
+#include "DasherLanguageModel.h"
+#include "../LanguageModelling/PPMLanguageModel.h"
+#include "../Alphabet/AlphabetMap.h"
+#include "../Alphabet/SymbolStream.h"
+#include <fstream>
+#include <string.h>
+#include <vector>
+
+using namespace Dasher;
+
+//The opaque handles wrap the C++ objects: a DlmModel holds a pointer to its model, a DlmAlphabet its map
+struct DlmModel {
+	PPMLanguageModel* model;
+};
+
+struct DlmAlphabet {
+	AlphabetMap map;
+};
+
+//Copies 'probs' into the caller's buffer, see dlmGetProbs
+static int copyProbs(const std::vector<unsigned int>& probs, unsigned int* buffer, int length) {
+	if (length<(int) probs.size()) return -1;
+	for (size_t i = 0; i<probs.size(); i++) buffer[i]=probs[i];
+	return probs.size();
+}
+
+static bool isValidSymbol(const DlmModel* model, int symbol) {
+	return symbol>=0 && symbol<=model->model->getNumOfSymbols();
+}
+
+//Also keeps getProbs' arithmetic in range: the slices of a level must add up to at most what is left
+static bool isValidQuery(const DlmModel* model, int length, int alpha, int beta, int uniform) {
+	return length>=model->model->getNumOfSymbols()+1 && alpha>=0 && alpha<=DLM_MAX_ALPHA && beta>=0
+			&& beta<=DLM_MAX_BETA && uniform>=0 && uniform<=DLM_MAX_UNIFORM;
+}
+
+//Every entry point catches all exceptions (in practice std::bad_alloc), which must not unwind into C code
+
+int dlmGetApiVersion(void) {
+	return DLM_API_VERSION;
+}
+
+DlmAlphabet* dlmCreateAlphabet(void) {
+	try {
+		return new DlmAlphabet();
+	} catch (...) {
+		return NULL;
+	}
+}
+
+void dlmDestroyAlphabet(DlmAlphabet* alphabet) {
+	delete alphabet;
+}
+
+int dlmAddToAlphabet(DlmAlphabet* alphabet, const char* utf8Character, int symbol) {
+	if (utf8Character==NULL || symbol<=0) return -1;
+	try {
+		alphabet->map.add(utf8Character, symbol);
+		return 0;
+	} catch (...) {
+		return -1;
+	}
+}
+
+int dlmGetSymbol(const DlmAlphabet* alphabet, const char* utf8Character) {
+	if (utf8Character==NULL) return -1;
+	try {
+		return alphabet->map.get(utf8Character);
+	} catch (...) {
+		return -1;
+	}
+}
+
+DlmModel* dlmCreateModel(int numOfSymbols, int maxOrder) {
+	if (numOfSymbols<=0 || numOfSymbols>MAX_NUM_OF_SYMBOLS || maxOrder<0) return NULL;
+	DlmModel* handle = NULL;
+	try {
+		handle=new DlmModel();
+		handle->model=new PPMLanguageModel(numOfSymbols, maxOrder);
+		return handle;
+	} catch (...) {
+		delete handle;
+		return NULL;
+	}
+}
+
+DlmModel* dlmLoadModel(const char* snapshotFileName) {
+	return dlmLoadModelWithError(snapshotFileName, NULL, 0);
+}
+
+DlmModel* dlmLoadModelWithError(const char* snapshotFileName, char* error, int errorLength) {
+	PPMLanguageModel* model = NULL;
+	std::string message;
+	try {
+		model=PPMLanguageModel::readFromFile(snapshotFileName, PPMLanguageModel::DIRECT_INDEXED_CHILDREN, &message);
+		if (model!=NULL) {
+			DlmModel* handle = new DlmModel();
+			handle->model=model;
+			return handle;
+		}
+	} catch (...) {
+		delete model;
+		message="Out of memory loading the snapshot";
+	}
+	if (error!=NULL && errorLength>0) {
+		strncpy(error, message.c_str(), errorLength-1);
+		error[errorLength-1]='\0';
+	}
+	return NULL;
+}
+
+int dlmSaveModel(const DlmModel* model, const char* snapshotFileName) {
+	try {
+		return model->model->writeToFile(snapshotFileName) ? 0 : -1;
+	} catch (...) {
+		return -1;
+	}
+}
+
+void dlmDestroyModel(DlmModel* model) {
+	if (model==NULL) return;
+	delete model->model;
+	delete model;
+}
+
+int dlmGetNumOfSymbols(const DlmModel* model) {
+	return model->model->getNumOfSymbols();
+}
+
+int dlmTrainFromFile(DlmModel* model, const DlmAlphabet* alphabet, const char* fileName) {
+	PPMLanguageModel::Context context = 0;
+	try {
+		std::ifstream in(fileName);
+		if (!in) return -1;
+		SymbolStream symbolStream(in);
+		context=model->model->createEmptyContext();
+		for (Symbol symbol; (symbol=symbolStream.next(&alphabet->map))!=-1;) {
+			//symbols beyond the model's become unknown (0), which learnSymbol skips: the context carries on
+			//from the symbol before, as if the unknown one wasn't there
+			model->model->learnSymbol(context, isValidSymbol(model, symbol) ? symbol : 0);
+		}
+		model->model->releaseContext(context);
+		return 0;
+	} catch (...) {
+		if (context!=0) model->model->releaseContext(context);
+		return -1;
+	}
+}
+
+DlmContext dlmCreateEmptyContext(DlmModel* model) {
+	try {
+		return model->model->createEmptyContext();
+	} catch (...) {
+		return 0;
+	}
+}
+
+DlmContext dlmCloneContext(DlmModel* model, DlmContext context) {
+	try {
+		return model->model->cloneContext(context);
+	} catch (...) {
+		return 0;
+	}
+}
+
+void dlmReleaseContext(DlmModel* model, DlmContext context) {
+	model->model->releaseContext(context);
+}
+
+int dlmEnterSymbol(DlmModel* model, DlmContext context, int symbol) {
+	if (!isValidSymbol(model, symbol)) return -1;
+	model->model->enterSymbol(context, symbol);
+	return 0;
+}
+
+int dlmLearnSymbol(DlmModel* model, DlmContext context, int symbol) {
+	if (!isValidSymbol(model, symbol)) return -1;
+	try {
+		model->model->learnSymbol(context, symbol);
+		return 0;
+	} catch (...) {
+		return -1;
+	}
+}
+
+int dlmGetProbs(const DlmModel* model, DlmContext context, unsigned int* probs, int length,
+		int alpha, int beta, int uniform) {
+	if (!isValidQuery(model, length, alpha, beta, uniform)) return -1;
+	try {
+		std::vector<unsigned int> result;
+		model->model->getProbs(context, result, alpha, beta, uniform);
+		return copyProbs(result, probs, length);
+	} catch (...) {
+		return -1;
+	}
+}
+
+int dlmGetProbsAfter(const DlmModel* model, const int* contextSymbols, int numOfContextSymbols,
+		unsigned int* probs, int length, int alpha, int beta, int uniform) {
+	if (!isValidQuery(model, length, alpha, beta, uniform)) return -1;
+	for (int i = 0; i<numOfContextSymbols; i++)
+		if (!isValidSymbol(model, contextSymbols[i])) return -1;
+	try {
+		std::vector<unsigned int> result;
+		model->model->getProbsAfter(contextSymbols, numOfContextSymbols, result, alpha, beta, uniform);
+		return copyProbs(result, probs, length);
+	} catch (...) {
+		return -1;
+	}
+}
@@ -0,0 +1,76 @@
+#ifndef DASHER_LANGUAGE_MODEL_C_API_INCLUDED
+#define DASHER_LANGUAGE_MODEL_C_API_INCLUDED
+
+/*
+ * Stable C interface to PPMLanguageModel and AlphabetMap, for embedding the language model in programs
+ * not written in C++. All handles are opaque. Functions returning int return 0 on success and -1 on
+ * failure unless stated otherwise; no C++ exception (e.g. running out of memory) leaves these functions.
+ * A model may be queried (dlmGetProbsAfter) from several threads at once as long as no thread learns or
+ * uses the context functions; those need external locking.
+ */
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define DLM_API_VERSION 2 /* 2: dlmLoadModelWithError */
+
+/* Accepted ranges of the alpha, beta and uniform parameters of dlmGetProbs and dlmGetProbsAfter */
+#define DLM_MAX_ALPHA 100
+#define DLM_MAX_BETA 100
+#define DLM_MAX_UNIFORM 1000 /* in thousandths of the probability mass */
+
+typedef struct DlmModel DlmModel;
+typedef struct DlmAlphabet DlmAlphabet;
+typedef size_t DlmContext;
+
+int dlmGetApiVersion(void);
+
+/* Alphabet: maps UTF-8 characters to symbol numbers 1..numOfSymbols */
+DlmAlphabet* dlmCreateAlphabet(void);
+void dlmDestroyAlphabet(DlmAlphabet* alphabet);
+int dlmAddToAlphabet(DlmAlphabet* alphabet, const char* utf8Character, int symbol); /* symbol must be >0 */
+int dlmGetSymbol(const DlmAlphabet* alphabet, const char* utf8Character); /* 0 if unknown, -1 on failure */
+
+/* Models; creating one fails (NULL) unless 0<numOfSymbols<=65536 and maxOrder>=0 */
+DlmModel* dlmCreateModel(int numOfSymbols, int maxOrder);
+DlmModel* dlmLoadModel(const char* snapshotFileName); /* NULL on failure */
+/*
+ * Like dlmLoadModel, but on failure also writes why to 'error' (if not NULL), as a NUL-terminated string
+ * truncated to 'errorLength' bytes. Nothing is printed either way.
+ */
+DlmModel* dlmLoadModelWithError(const char* snapshotFileName, char* error, int errorLength);
+int dlmSaveModel(const DlmModel* model, const char* snapshotFileName);
+void dlmDestroyModel(DlmModel* model);
+int dlmGetNumOfSymbols(const DlmModel* model);
+/* Learns the text in a UTF-8 file, converted to symbols by 'alphabet', in a fresh context */
+int dlmTrainFromFile(DlmModel* model, const DlmAlphabet* alphabet, const char* fileName);
+
+/* Contexts; creating or cloning one returns 0 on failure. Symbols must be in 0..numOfSymbols. */
+DlmContext dlmCreateEmptyContext(DlmModel* model);
+DlmContext dlmCloneContext(DlmModel* model, DlmContext context);
+void dlmReleaseContext(DlmModel* model, DlmContext context);
+int dlmEnterSymbol(DlmModel* model, DlmContext context, int symbol);
+int dlmLearnSymbol(DlmModel* model, DlmContext context, int symbol);
+
+/*
+ * Probability distributions are written to 'probs', which must have room for numOfSymbols+1 values
+ * (index 0 is unused and always 0). 'length' is the size of 'probs'. Returns numOfSymbols+1, or -1
+ * (writing nothing) if 'probs' is too short or alpha, beta or uniform is outside 0..DLM_MAX_*.
+ */
+int dlmGetProbs(const DlmModel* model, DlmContext context, unsigned int* probs, int length,
+		int alpha, int beta, int uniform);
+/*
+ * Distribution after entering 'contextSymbols' into an empty context, without using a context handle.
+ * Also returns -1 if a symbol is outside 0..numOfSymbols.
+ */
+int dlmGetProbsAfter(const DlmModel* model, const int* contextSymbols, int numOfContextSymbols,
+		unsigned int* probs, int length, int alpha, int beta, int uniform);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
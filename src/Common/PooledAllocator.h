@@ -1,6 +1,7 @@
 #ifndef POOLED_ALLOCATOR_INCLUDED
 #define POOLED_ALLOCATOR_INCLUDED
 
+#include <cstddef> //for size_t, NULL
 #include <vector>
 
 //PooledAllocator allocates objects T in fixed-size blocks (specified in the constructor)
@@ -0,0 +1,118 @@
+//Prediction daemon: serves a language model snapshot over a Unix domain socket using the batched binary
+//protocol in Protocol.h, with one thread per connection.
+//Usage: DasherLMDaemon <socket path> <snapshot file>
+
+#include "../CApi/DasherLanguageModel.h"
+#include "Protocol.h"
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <vector>
+
+using namespace Dasher;
+
+static DlmModel* model;
+
+static void* serveConnection(void* arg) {
+	int fd = (int) (intptr_t) arg;
+	int distributionLength = dlmGetNumOfSymbols(model)+1;
+	BufferedReader reader(fd);
+	std::vector<int> contextSymbols;
+	std::vector<unsigned int> response; //header followed by all distributions, sent with one write
+	RequestHeader request;
+	while (reader.read(&request, sizeof(request))) {
+		ResponseHeader header;
+		header.magic=RESPONSE_MAGIC;
+		header.status=STATUS_OK;
+		header.numOfQueries=0;
+		header.distributionLength=distributionLength;
+		bool valid = request.magic==REQUEST_MAGIC && (request.type==REQUEST_INFO || request.type==REQUEST_GET_PROBS)
+				&& request.numOfQueries<=MAX_QUERIES_PER_REQUEST
+				&& request.numOfQueries<=MAX_RESPONSE_SIZE/sizeof(unsigned int)/distributionLength
+				&& request.alpha>=0 && request.alpha<=DLM_MAX_ALPHA && request.beta>=0 && request.beta<=DLM_MAX_BETA
+				&& request.uniform>=0 && request.uniform<=DLM_MAX_UNIFORM;
+		if (valid && request.type==REQUEST_GET_PROBS) header.numOfQueries=request.numOfQueries;
+		size_t headerWords = sizeof(header)/sizeof(unsigned int);
+		response.resize(headerWords); //grown by each query read, so a header alone commits no memory
+		bool complete = true;
+		for (uint32_t i = 0; i<header.numOfQueries; i++) {
+			int32_t length;
+			if (!reader.read(&length, sizeof(length))) complete=false;
+			else if (length<0 || length>MAX_CONTEXT_LENGTH) valid=false;
+			if (!valid || !complete) break;
+			contextSymbols.resize(length);
+			if (length>0 && !reader.read(&contextSymbols[0], length*sizeof(int))) {
+				complete=false;
+				break;
+			}
+			response.resize(headerWords+(i+1)*distributionLength);
+			if (dlmGetProbsAfter(model, length>0 ? &contextSymbols[0] : NULL, length,
+					&response[headerWords+i*distributionLength], distributionLength,
+					request.alpha, request.beta, request.uniform)<0) {
+				valid=false; //symbol out of range
+				break;
+			}
+		}
+		if (!complete) break; //client went away in the middle of a request
+		if (!valid) {
+			header.status=STATUS_BAD_REQUEST;
+			header.numOfQueries=0;
+			response.resize(headerWords);
+		}
+		memcpy(&response[0], &header, sizeof(header));
+		if (!writeFully(fd, &response[0], response.size()*sizeof(unsigned int)) || !valid) break;
+	}
+	close(fd);
+	return NULL;
+}
+
+int main(int argc, char** argv) {
+	if (argc!=3) {
+		printf("Usage: %s <socket path> <snapshot file>\n", argv[0]);
+		return 1;
+	}
+	char error[256];
+	model=dlmLoadModelWithError(argv[2], error, sizeof(error));
+	if (model==NULL) {
+		printf("%s\n", error);
+		return 1;
+	}
+	signal(SIGPIPE, SIG_IGN); //a client disconnecting mid-response must not kill the daemon
+	int listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+	sockaddr_un address;
+	memset(&address, 0, sizeof(address));
+	address.sun_family=AF_UNIX;
+	strncpy(address.sun_path, argv[1], sizeof(address.sun_path)-1);
+	unlink(argv[1]);
+	if (bind(listenFd, (sockaddr*) &address, sizeof(address))!=0 || listen(listenFd, 64)!=0) {
+		perror("Could not listen on socket");
+		return 1;
+	}
+	printf("Serving %s on %s\n", argv[2], argv[1]);
+	fflush(stdout);
+	while (true) {
+		int fd = accept(listenFd, NULL, NULL);
+		if (fd<0) {
+			if (errno==EINTR || errno==ECONNABORTED) continue;
+			if (errno==EMFILE || errno==ENFILE || errno==ENOBUFS || errno==ENOMEM) {
+				//out of descriptors or memory until connections close; the pending connection keeps
+				//accept failing, so retrying at once would spin
+				usleep(100000);
+				continue;
+			}
+			perror("Could not accept connection");
+			return 1;
+		}
+		pthread_t thread;
+		if (pthread_create(&thread, NULL, serveConnection, (void*) (intptr_t) fd)!=0) {
+			close(fd);
+			continue;
+		}
+		pthread_detach(thread);
+	}
+}
@@ -0,0 +1,136 @@
+//Load generator for the prediction daemon: several connections send batches of random contexts for a
+//while, then the query throughput and the latency percentiles of the batches are printed.
+//Usage: DasherLMLoadGenerator <socket path> [connections] [queries per batch] [seconds] [context length]
+
+#include "Protocol.h"
+#include <algorithm>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+
+using namespace Dasher;
+
+static unsigned long long getNanos() {
+	timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec*1000000000ULL+now.tv_nsec;
+}
+
+static int connectTo(const char* socketPath) {
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	sockaddr_un address;
+	memset(&address, 0, sizeof(address));
+	address.sun_family=AF_UNIX;
+	strncpy(address.sun_path, socketPath, sizeof(address.sun_path)-1);
+	if (connect(fd, (sockaddr*) &address, sizeof(address))!=0) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+//Sends 'request' plus 'payload' and reads the response into 'probs'; returns false on any error
+static bool roundTrip(int fd, const RequestHeader& request, const std::vector<int32_t>& payload,
+		ResponseHeader& response, std::vector<unsigned int>& probs) {
+	std::vector<char> message(sizeof(request)+payload.size()*sizeof(int32_t));
+	memcpy(&message[0], &request, sizeof(request));
+	if (!payload.empty()) memcpy(&message[sizeof(request)], &payload[0], payload.size()*sizeof(int32_t));
+	if (!writeFully(fd, &message[0], message.size())) return false;
+	if (!readFully(fd, &response, sizeof(response)) || response.magic!=RESPONSE_MAGIC || response.status!=STATUS_OK)
+		return false;
+	probs.resize(response.numOfQueries*response.distributionLength);
+	return probs.empty() || readFully(fd, &probs[0], probs.size()*sizeof(unsigned int));
+}
+
+class Client {
+	public:
+		const char* socketPath;
+		int batchSize;
+		int contextLength;
+		unsigned long long deadline;
+		unsigned int seed;
+		std::vector<unsigned long long> latencies; //of each batch, in ns
+		bool failed;
+};
+
+static void* runClient(void* arg) {
+	Client& client = *(Client*) arg;
+	client.failed=true;
+	int fd = connectTo(client.socketPath);
+	if (fd<0) return NULL;
+	RequestHeader request;
+	memset(&request, 0, sizeof(request));
+	request.magic=REQUEST_MAGIC;
+	request.type=REQUEST_INFO;
+	ResponseHeader response;
+	std::vector<int32_t> payload;
+	std::vector<unsigned int> probs;
+	if (!roundTrip(fd, request, payload, response, probs)) {
+		close(fd);
+		return NULL;
+	}
+	int numOfSymbols = response.distributionLength-1;
+	request.type=REQUEST_GET_PROBS;
+	request.numOfQueries=client.batchSize;
+	request.alpha=49;
+	request.beta=77;
+	request.uniform=80;
+	while (getNanos()<client.deadline) {
+		payload.clear();
+		for (int i = 0; i<client.batchSize; i++) {
+			payload.push_back(client.contextLength);
+			for (int j = 0; j<client.contextLength; j++) payload.push_back(1+rand_r(&client.seed)%numOfSymbols);
+		}
+		unsigned long long start = getNanos();
+		if (!roundTrip(fd, request, payload, response, probs)) {
+			close(fd);
+			return NULL;
+		}
+		client.latencies.push_back(getNanos()-start);
+	}
+	close(fd);
+	client.failed=false;
+	return NULL;
+}
+
+int main(int argc, char** argv) {
+	if (argc<2) {
+		printf("Usage: %s <socket path> [connections] [queries per batch] [seconds] [context length]\n", argv[0]);
+		return 1;
+	}
+	int numOfConnections = argc>2 ? atoi(argv[2]) : 4;
+	int batchSize = argc>3 ? atoi(argv[3]) : 64;
+	double seconds = argc>4 ? atof(argv[4]) : 5;
+	int contextLength = argc>5 ? atoi(argv[5]) : 8;
+	std::vector<Client> clients(numOfConnections);
+	std::vector<pthread_t> threads(numOfConnections);
+	unsigned long long start = getNanos();
+	for (int i = 0; i<numOfConnections; i++) {
+		clients[i].socketPath=argv[1];
+		clients[i].batchSize=batchSize;
+		clients[i].contextLength=contextLength;
+		clients[i].deadline=start+static_cast<unsigned long long>(seconds*1e9);
+		clients[i].seed=i+1;
+		pthread_create(&threads[i], NULL, runClient, &clients[i]);
+	}
+	std::vector<unsigned long long> latencies;
+	for (int i = 0; i<numOfConnections; i++) {
+		pthread_join(threads[i], NULL);
+		if (clients[i].failed) printf("Connection %i failed\n", i);
+		latencies.insert(latencies.end(), clients[i].latencies.begin(), clients[i].latencies.end());
+	}
+	double elapsed = (getNanos()-start)/1e9;
+	if (latencies.empty()) return 1;
+	std::sort(latencies.begin(), latencies.end());
+	printf("%i connections, %i queries per batch, context length %i: %.0f queries/s, %.0f batches/s\n",
+			numOfConnections, batchSize, contextLength, latencies.size()*batchSize/elapsed, latencies.size()/elapsed);
+	printf("Batch latency: p50 %.1f us, p99 %.1f us, max %.1f us\n", latencies[latencies.size()/2]/1e3,
+			latencies[latencies.size()*99/100]/1e3, latencies.back()/1e3);
+	return 0;
+}
@@ -0,0 +1,53 @@
+#include "Protocol.h"
+
+#include <algorithm>
+#include <errno.h>
+#include <string.h> //for memcpy
+#include <unistd.h>
+
+using namespace Dasher;
+
+bool Dasher::readFully(int fd, void* buffer, size_t length) {
+	char* pos = (char*) buffer;
+	while (length>0) {
+		ssize_t result = read(fd, pos, length);
+		if (result<0 && errno==EINTR) continue;
+		if (result<=0) return false;
+		pos+=result;
+		length-=result;
+	}
+	return true;
+}
+
+bool Dasher::writeFully(int fd, const void* buffer, size_t length) {
+	const char* pos = (const char*) buffer;
+	while (length>0) {
+		ssize_t result = write(fd, pos, length);
+		if (result<0 && errno==EINTR) continue;
+		if (result<=0) return false;
+		pos+=result;
+		length-=result;
+	}
+	return true;
+}
+
+bool BufferedReader::read(void* target, size_t length) {
+	char* targetPos = (char*) target;
+	while (length>0) {
+		if (pos==validBufferLength) {
+			ssize_t result;
+			do {
+				result=::read(fd, buffer, sizeof(buffer));
+			} while (result<0 && errno==EINTR);
+			if (result<=0) return false;
+			pos=0;
+			validBufferLength=result;
+		}
+		size_t chunk = std::min(length, validBufferLength-pos);
+		memcpy(targetPos, &buffer[pos], chunk);
+		pos+=chunk;
+		targetPos+=chunk;
+		length-=chunk;
+	}
+	return true;
+}
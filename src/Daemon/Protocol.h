@@ -0,0 +1,72 @@
+#ifndef PROTOCOL_INCLUDED
+#define PROTOCOL_INCLUDED
+
+#include <stddef.h>
+#include <stdint.h>
+
+//Binary protocol between the prediction daemon and its clients over a Unix domain socket. Both ends run
+//on the same machine, so all fields are in native byte order. A connection carries any number of
+//request/response pairs, one after the other.
+//Request:  RequestHeader, then for each of numOfQueries queries an int32 number of context symbols
+//          followed by that many int32 symbols
+//Response: ResponseHeader, then for each query distributionLength uint32 probabilities, as returned by
+//          PPMLanguageModel::getProbs for an empty context after entering the query's symbols
+//An INFO request has no queries; its response only carries distributionLength (numOfSymbols+1).
+//alpha and beta must be in 0..100 and uniform in 0..1000, see dlmGetProbs; requests with parameters,
+//symbols or sizes out of range are answered with STATUS_BAD_REQUEST.
+
+#define REQUEST_MAGIC 0x51524c44 //"DLRQ"
+#define RESPONSE_MAGIC 0x53524c44 //"DLRS"
+#define MAX_QUERIES_PER_REQUEST 65536
+#define MAX_CONTEXT_LENGTH 1024
+#define MAX_RESPONSE_SIZE (1<<25) //bytes of distributions per response; limits numOfQueries for large alphabets
+
+namespace Dasher {
+
+	enum RequestType {
+		REQUEST_INFO = 0,
+		REQUEST_GET_PROBS = 1
+	};
+
+	enum ResponseStatus {
+		STATUS_OK = 0,
+		STATUS_BAD_REQUEST = 1 //the daemon closes the connection after sending this
+	};
+
+	struct RequestHeader {
+		uint32_t magic;
+		uint32_t type; //RequestType
+		uint32_t numOfQueries;
+		int32_t alpha;
+		int32_t beta;
+		int32_t uniform;
+	};
+
+	struct ResponseHeader {
+		uint32_t magic;
+		uint32_t status; //ResponseStatus
+		uint32_t numOfQueries;
+		uint32_t distributionLength;
+	};
+
+	//Read/write exactly 'length' bytes, retrying partial transfers; return false on error or EOF
+	bool readFully(int fd, void* buffer, size_t length);
+	bool writeFully(int fd, const void* buffer, size_t length);
+
+	//Reads from a socket through a buffer, so that the many small fields of a request don't each cost a
+	//system call
+	class BufferedReader {
+		public:
+			BufferedReader(int fd) : fd(fd), pos(0), validBufferLength(0) {
+				//empty
+			}
+			bool read(void* buffer, size_t length); //like readFully
+		private:
+			int fd;
+			char buffer[65536];
+			size_t pos;
+			size_t validBufferLength;
+	};
+}
+
+#endif
@@ -0,0 +1,674 @@
+//Differential fuzzer: trains the reference PPMLanguageModel on a symbol stream, builds every alternative
+//engine/layout listed in makeVariants from the same stream and checks that all of them hold the same tree
+//(see PPMLanguageModel::hasSameTree) and return exactly the same distributions. As all of them share the
+//reference's tree code, the reference itself is checked against OracleModel, a separate naive
+//implementation. SuffixArrayLanguageModel is checked against NaiveSubstringModel, with learning, entering
+//and queries interleaved across rebuilds of its index. Also feeds (malformed) UTF-8 to SymbolStream,
+//checking AlphabetMap and TokenMap against each other.
+//Usage: DasherLMFuzzer [iterations] [seed]
+//  Randomized mode, generating structured inputs (skewed symbol streams, runs of few symbols, truncated
+//  UTF-8 sequences...). Progress and failures go to stderr; stdout, where SymbolStream reports invalid
+//  UTF-8, is discarded. Stops with abort() on the first failed check.
+//With libFuzzer (and clang), the same checks run on the fuzzer's inputs:
+//  clang++ -fsanitize=fuzzer,address -DDASHER_LIBFUZZER -o DasherLMLibFuzzer <sources as for DasherLMFuzzer>
+
+#include "../LanguageModelling/PPMLanguageModel.h"
+#include "../LanguageModelling/SuffixArrayLanguageModel.h"
+#include "../Alphabet/AlphabetMap.h"
+#include "../Alphabet/TokenMap.h"
+#include "../Alphabet/SymbolStream.h"
+#include <algorithm>
+#include <deque>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+using namespace Dasher;
+
+#define NORMALIZATION (1<<16) //see PPMLanguageModel
+
+static std::string currentCase; //described in failure messages
+
+static void check(bool condition, const char* what) {
+	if (condition) return;
+	fprintf(stderr, "Check failed: %s (%s)\n", what, currentCase.c_str());
+	abort();
+}
+
+//Hands out the bytes of a fuzzer input as numbers; returns 0 once the input is used up
+class ByteReader {
+	public:
+		ByteReader(const uint8_t* data, size_t size) : data(data), size(size), pos(0) {
+			//empty
+		}
+		bool atEnd() const {
+			return pos>=size;
+		}
+		int next() {
+			return atEnd() ? 0 : data[pos++];
+		}
+	private:
+		const uint8_t* data;
+		size_t size;
+		size_t pos;
+};
+
+//Deterministic pseudo random numbers for choosing queries, seeded from the input
+class QueryRandom {
+	public:
+		QueryRandom(const uint8_t* data, size_t size) : state(2166136261u) {
+			for (size_t i = 0; i<size; i++) state=(state^data[i])*16777619u;
+		}
+		int next(int bound) {
+			state=state*1103515245u+12345u;
+			return (state>>8)%bound;
+		}
+	private:
+		uint32_t state;
+};
+
+//Sizes to pick from (by the first input byte): around MAX_RUN, the hash sizes, one and two bytes per symbol
+static const int alphabetSizes[] = {1, 2, 3, 4, 5, 8, 9, 16, 19, 39, 62, 100, 254, 256, 1000, 4000};
+
+//Model inputs: alphabet size index, maxOrder, alpha, beta, uniform, then the stream: one byte per symbol
+//(two if the alphabet has 255 symbols or more), 255 in the (first) byte starting a new context
+class ModelInput {
+	public:
+		int numOfSymbols;
+		int maxOrder;
+		int alpha, beta, uniform;
+		std::vector<std::vector<Symbol> > sequences; //each learned in a fresh context
+		ModelInput(const uint8_t* data, size_t size) {
+			ByteReader reader(data, size);
+			numOfSymbols=alphabetSizes[reader.next()%(sizeof(alphabetSizes)/sizeof(*alphabetSizes))];
+			maxOrder=reader.next()%8;
+			alpha=reader.next()%100;
+			beta=reader.next()%100; //at most 99, so that 100*count-beta stays positive
+			uniform=reader.next()*4%1001;
+			bool twoBytes = numOfSymbols>=255;
+			sequences.resize(1);
+			while (!reader.atEnd()) {
+				int value = reader.next();
+				if (value==255) {
+					sequences.push_back(std::vector<Symbol>());
+					continue;
+				}
+				if (twoBytes) value=(value<<8)|reader.next();
+				sequences.back().push_back(value%(numOfSymbols+1));
+			}
+		}
+};
+
+//Independent oracle for the reference: the same model written as plainly as possible, with std::map
+//children keyed by external symbol, so that a bug in the child storage and tree code shared by all variants
+//(findSymbol, addChild, the iterators, the vines) shows up as a difference
+class OracleModel {
+	public:
+		struct Node {
+			int count;
+			Node* vine;
+			std::map<Symbol, Node*> children;
+			Node() : count(1), vine(NULL) {
+				//empty
+			}
+			~Node() {
+				for (std::map<Symbol, Node*>::iterator it = children.begin(); it!=children.end(); ++it) delete it->second;
+			}
+		};
+		struct Context {
+			Node* head;
+			int order;
+		};
+		int numOfNodes; //including the root
+		Node root;
+		OracleModel(int numOfSymbols, int maxOrder) : numOfNodes(1), numOfSymbols(numOfSymbols), maxOrder(maxOrder) {
+			//empty
+		}
+		Context createEmptyContext() {
+			Context context = {&root, 0};
+			return context;
+		}
+		//Update exclusion: a new node gets new nodes (count 1) down its whole vine chain, an existing node
+		//only has its own count incremented
+		Node* addSymbolToNode(Node* node, Symbol symbol) {
+			Node*& child = node->children[symbol];
+			if (child!=NULL) {
+				child->count++;
+				return child;
+			}
+			child=new Node();
+			numOfNodes++;
+			child->vine=(node==&root ? &root : addSymbolToNode(node->vine, symbol));
+			return child;
+		}
+		void learnSymbol(Context& context, Symbol symbol) {
+			if (symbol==0) return;
+			context.head=addSymbolToNode(context.head, symbol);
+			context.order++;
+			while (context.order>maxOrder) {
+				context.head=context.head->vine;
+				context.order--;
+			}
+		}
+		//Moves to the longest context, at most maxOrder long, that ends with 'symbol' and is in the tree
+		void enterSymbol(Context& context, Symbol symbol) const {
+			if (symbol==0) return;
+			while (true) {
+				if (context.order<maxOrder) {
+					std::map<Symbol, Node*>::const_iterator found = context.head->children.find(symbol);
+					if (found!=context.head->children.end()) {
+						context.head=found->second;
+						context.order++;
+						return;
+					}
+				}
+				if (context.head->vine==NULL) return;
+				context.head=context.head->vine;
+				context.order--;
+			}
+		}
+		void getProbs(const Context& context, std::vector<unsigned int>& probs, int alpha, int beta, int uniform) const {
+			int uniformAdd = std::max(1, NORMALIZATION*uniform/1000/numOfSymbols);
+			probs.assign(numOfSymbols+1, 0);
+			unsigned int toSpend = NORMALIZATION-numOfSymbols*uniformAdd;
+			for (const Node* node = context.head; node!=NULL; node=node->vine) {
+				int total = 0;
+				std::map<Symbol, Node*>::const_iterator it;
+				for (it=node->children.begin(); it!=node->children.end(); ++it) total+=it->second->count;
+				if (total==0) continue;
+				unsigned int sizeOfSlice = toSpend;
+				for (it=node->children.begin(); it!=node->children.end(); ++it) {
+					unsigned int p = static_cast<int64_t>(sizeOfSlice)*(100*it->second->count-beta)/(100*total+alpha);
+					probs[it->first]+=p;
+					toSpend-=p;
+				}
+			}
+			unsigned int share = toSpend/numOfSymbols;
+			for (int i = 1; i<=numOfSymbols; i++) {
+				probs[i]+=share;
+				toSpend-=share;
+			}
+			for (int i = 1, left = numOfSymbols; i<=numOfSymbols; i++, left--) {
+				unsigned int p = toSpend/left;
+				probs[i]+=p+uniformAdd;
+				toSpend-=p;
+			}
+		}
+	private:
+		int numOfSymbols;
+		int maxOrder;
+};
+
+//Reads the tree stored in a snapshot (see PPMLanguageModel::writeToFile) into oracle nodes without vines,
+//keyed by external symbol; false if it isn't a well formed tree
+static bool readSnapshotTree(const char* fileName, OracleModel::Node& root) {
+	std::ifstream in(fileName, std::ios::binary);
+	int32_t header[5];
+	if (!in.read((char*) header, sizeof(header))) return false;
+	std::vector<int32_t> toExternal(header[2]+1);
+	for (int i = 0; i<=header[2]; i++) {
+		int32_t entry[2];
+		if (!in.read((char*) entry, sizeof(entry))) return false;
+		toExternal[i]=entry[0];
+	}
+	int32_t record[3];
+	if (!in.read((char*) record, sizeof(record))) return false;
+	std::deque<std::pair<OracleModel::Node*, int> > queue(1, std::make_pair(&root, record[2]));
+	while (!queue.empty()) {
+		OracleModel::Node* parent = queue.front().first;
+		int numOfChildren = queue.front().second;
+		queue.pop_front();
+		for (int i = 0; i<numOfChildren; i++) {
+			if (!in.read((char*) record, sizeof(record)) || record[0]<1 || record[0]>header[2]) return false;
+			OracleModel::Node*& child = parent->children[toExternal[record[0]]];
+			if (child!=NULL) return false; //the same symbol twice
+			child=new OracleModel::Node();
+			child->count=record[1];
+			queue.push_back(std::make_pair(child, record[2]));
+		}
+	}
+	return in.peek()==EOF;
+}
+
+static bool haveSameChildren(const OracleModel::Node& a, const OracleModel::Node& b) {
+	if (a.children.size()!=b.children.size()) return false;
+	std::map<Symbol, OracleModel::Node*>::const_iterator itA = a.children.begin(), itB = b.children.begin();
+	for (; itA!=a.children.end(); ++itA, ++itB) {
+		if (itA->first!=itB->first || itA->second->count!=itB->second->count) return false;
+		if (!haveSameChildren(*itA->second, *itB->second)) return false;
+	}
+	return true;
+}
+
+static void train(PPMLanguageModel* model, const std::vector<Symbol>& sequence, size_t from, size_t to,
+		PPMLanguageModel::Context context) {
+	for (size_t i = from; i<to; i++) model->learnSymbol(context, sequence[i]);
+}
+
+//The engines/layouts compared against the reference, all trained on 'input'
+static std::vector<PPMLanguageModel*> makeVariants(const ModelInput& input, const PPMLanguageModel& reference,
+		std::vector<std::string>& names) {
+	std::vector<PPMLanguageModel*> variants;
+	//renumbered halfway through every sequence and again at the end
+	PPMLanguageModel* remapped = new PPMLanguageModel(input.numOfSymbols, input.maxOrder);
+	for (size_t i = 0; i<input.sequences.size(); i++) {
+		const std::vector<Symbol>& sequence = input.sequences[i];
+		PPMLanguageModel::Context context = remapped->createEmptyContext();
+		train(remapped, sequence, 0, sequence.size()/2, context);
+		remapped->remapSymbolsByFrequency();
+		train(remapped, sequence, sequence.size()/2, sequence.size(), context);
+		remapped->releaseContext(context);
+	}
+	remapped->remapSymbolsByFrequency();
+	variants.push_back(remapped);
+	names.push_back("remapped");
+	variants.push_back(reference.clone());
+	names.push_back("clone");
+	variants.push_back(remapped->clone());
+	names.push_back("clone of remapped");
+	char snapshotFileName[64];
+	snprintf(snapshotFileName, sizeof(snapshotFileName), "/tmp/DasherLMFuzzer.%i.snapshot", (int) getpid());
+	check(remapped->writeToFile(snapshotFileName), "writing snapshot");
+	PPMLanguageModel* loaded = PPMLanguageModel::readFromFile(snapshotFileName);
+	unlink(snapshotFileName);
+	check(loaded!=NULL, "reading snapshot");
+	variants.push_back(loaded);
+	names.push_back("snapshot of remapped");
+	//children of dense nodes in ChildBitmaps instead of direct indexed arrays
+	PPMLanguageModel* bitmapRanked = new PPMLanguageModel(input.numOfSymbols, input.maxOrder,
+			PPMLanguageModel::BITMAP_RANKED_CHILDREN);
+	for (size_t i = 0; i<input.sequences.size(); i++) {
+		PPMLanguageModel::Context context = bitmapRanked->createEmptyContext();
+		train(bitmapRanked, input.sequences[i], 0, input.sequences[i].size(), context);
+		bitmapRanked->releaseContext(context);
+	}
+	variants.push_back(bitmapRanked);
+	names.push_back("bitmap ranked");
+	variants.push_back(bitmapRanked->clone());
+	names.push_back("clone of bitmap ranked");
+	check(remapped->writeToFile(snapshotFileName), "writing snapshot");
+	loaded=PPMLanguageModel::readFromFile(snapshotFileName, PPMLanguageModel::BITMAP_RANKED_CHILDREN);
+	unlink(snapshotFileName);
+	check(loaded!=NULL, "reading snapshot");
+	variants.push_back(loaded);
+	names.push_back("snapshot of remapped, bitmap ranked");
+	loaded=loaded->clone();
+	loaded->remapSymbolsByFrequency();
+	variants.push_back(loaded);
+	names.push_back("remapped again, bitmap ranked");
+	return variants;
+}
+
+//Checks what holds for every distribution: index 0 unused, every symbol at least the uniform share, and
+//the integer rounding spends exactly NORMALIZATION
+static void checkDistribution(const std::vector<unsigned int>& probs, const ModelInput& input) {
+	check((int) probs.size()==input.numOfSymbols+1 && probs[0]==0, "size of distribution");
+	unsigned int uniformAdd = std::max(1, NORMALIZATION*input.uniform/1000/input.numOfSymbols);
+	unsigned int sum = 0;
+	for (int i = 1; i<=input.numOfSymbols; i++) {
+		check(probs[i]>=uniformAdd, "uniform share");
+		sum+=probs[i];
+	}
+	check(sum==NORMALIZATION, "sum of distribution");
+}
+
+//Naive oracle for SuffixArrayLanguageModel: the learned text (0 between sequences learned in different
+//contexts) and, for a query, the number of symbols at the end of the context's history (up to maxOrder)
+//that precede each position of the text; a symbol counts at every depth up to that number
+class NaiveSubstringModel {
+	public:
+		NaiveSubstringModel(int numOfSymbols, int maxOrder) :
+				numOfSymbols(numOfSymbols), maxOrder(maxOrder), lastLearnContext(-1) {
+			//empty
+		}
+		void learnSymbol(int context, std::vector<Symbol>& history, Symbol symbol) {
+			if (symbol==0) return;
+			if (context!=lastLearnContext && !text.empty()) text.push_back(0);
+			lastLearnContext=context;
+			history.push_back(symbol);
+			text.push_back(symbol);
+		}
+		void releaseContext(int context) { //a new context in its place starts a new sequence
+			if (context==lastLearnContext) lastLearnContext=-1;
+		}
+		void getProbs(const std::vector<Symbol>& history, std::vector<unsigned int>& probs, int alpha, int beta,
+				int uniform) const {
+			int maxLength = std::min(static_cast<int>(history.size()), maxOrder);
+			std::vector<std::pair<int, Symbol> > matches; //(length, symbol) for every position but separators
+			for (size_t pos = 0; pos<text.size(); pos++) {
+				if (text[pos]==0) continue;
+				int length = 0;
+				while (length<maxLength && length<static_cast<int>(pos)
+						&& text[pos-1-length]==history[history.size()-1-length]) length++;
+				matches.push_back(std::make_pair(length, text[pos]));
+			}
+			std::sort(matches.begin(), matches.end());
+			int uniformAdd = std::max(1, NORMALIZATION*uniform/1000/numOfSymbols);
+			probs.assign(numOfSymbols+1, 0);
+			unsigned int toSpend = NORMALIZATION-numOfSymbols*uniformAdd;
+			std::vector<int> counts(numOfSymbols+1, 0);
+			std::vector<Symbol> seen;
+			int total = 0;
+			for (int depth = matches.empty() ? -1 : matches.back().first; depth>=0; depth--) {
+				while (!matches.empty() && matches.back().first>=depth) {
+					Symbol symbol = matches.back().second;
+					if (counts[symbol]++==0) seen.push_back(symbol);
+					total++;
+					matches.pop_back();
+				}
+				if (total==0) continue;
+				unsigned int sizeOfSlice = toSpend;
+				for (size_t i = 0; i<seen.size(); i++) {
+					unsigned int p = static_cast<int64_t>(sizeOfSlice)*(100*counts[seen[i]]-beta)/(100*total+alpha);
+					probs[seen[i]]+=p;
+					toSpend-=p;
+				}
+			}
+			unsigned int share = toSpend/numOfSymbols;
+			for (int i = 1; i<=numOfSymbols; i++) {
+				probs[i]+=share;
+				toSpend-=share;
+			}
+			for (int i = 1, left = numOfSymbols; i<=numOfSymbols; i++, left--) {
+				unsigned int p = toSpend/left;
+				probs[i]+=p+uniformAdd;
+				toSpend-=p;
+			}
+		}
+	private:
+		int numOfSymbols;
+		int maxOrder;
+		std::vector<Symbol> text;
+		int lastLearnContext; //-1 if none
+};
+
+static void fuzzModels(const uint8_t* data, size_t size) {
+	ModelInput input(data, size);
+	PPMLanguageModel reference(input.numOfSymbols, input.maxOrder);
+	OracleModel oracle(input.numOfSymbols, input.maxOrder);
+	for (size_t i = 0; i<input.sequences.size(); i++) {
+		PPMLanguageModel::Context context = reference.createEmptyContext();
+		train(&reference, input.sequences[i], 0, input.sequences[i].size(), context);
+		reference.releaseContext(context);
+		OracleModel::Context oracleContext = oracle.createEmptyContext();
+		for (size_t j = 0; j<input.sequences[i].size(); j++) oracle.learnSymbol(oracleContext, input.sequences[i][j]);
+	}
+	//the reference's tree, as stored in a snapshot, must be the oracle's
+	char snapshotFileName[64];
+	snprintf(snapshotFileName, sizeof(snapshotFileName), "/tmp/DasherLMFuzzer.%i.snapshot", (int) getpid());
+	check(reference.writeToFile(snapshotFileName), "writing snapshot");
+	OracleModel::Node storedRoot;
+	bool wellFormed = readSnapshotTree(snapshotFileName, storedRoot);
+	unlink(snapshotFileName);
+	check(wellFormed, "snapshot of reference is a tree");
+	check(haveSameChildren(storedRoot, oracle.root), "tree of reference matches oracle");
+	check(reference.getNumOfNodesAllocated()==oracle.numOfNodes, "number of nodes of reference matches oracle");
+	std::vector<std::string> names;
+	std::vector<PPMLanguageModel*> variants = makeVariants(input, reference, names);
+	for (size_t v = 0; v<variants.size(); v++) {
+		currentCase+=", variant "+names[v];
+		check(reference.hasSameTree(*variants[v]) && variants[v]->hasSameTree(reference), "same tree");
+		currentCase.resize(currentCase.rfind(", variant"));
+	}
+	//Query contexts, half of them taken from the training stream (so they reach deep nodes)
+	QueryRandom random(data, size);
+	PPMLanguageModel::ExpansionBuffer buffer;
+	std::vector<Symbol> childSymbols;
+	for (Symbol symbol = 0; symbol<=input.numOfSymbols; symbol++)
+		if (input.numOfSymbols<=300 || random.next(input.numOfSymbols/100)==0) childSymbols.push_back(symbol);
+	for (int q = 0; q<20; q++) {
+		std::vector<Symbol> contextSymbols(random.next(input.maxOrder+3));
+		const std::vector<Symbol>& sequence = input.sequences[random.next(input.sequences.size())];
+		bool fromStream = q%2==0 && sequence.size()>contextSymbols.size();
+		size_t start = fromStream ? random.next(sequence.size()-contextSymbols.size()) : 0;
+		for (size_t i = 0; i<contextSymbols.size(); i++)
+			contextSymbols[i]=fromStream ? sequence[start+i] : random.next(input.numOfSymbols+1);
+		std::vector<unsigned int> expected, probs;
+		PPMLanguageModel::Context context = reference.createEmptyContext();
+		for (size_t i = 0; i<contextSymbols.size(); i++) reference.enterSymbol(context, contextSymbols[i]);
+		reference.getProbs(context, expected, input.alpha, input.beta, input.uniform);
+		checkDistribution(expected, input);
+		OracleModel::Context oracleContext = oracle.createEmptyContext();
+		for (size_t i = 0; i<contextSymbols.size(); i++) oracle.enterSymbol(oracleContext, contextSymbols[i]);
+		oracle.getProbs(oracleContext, probs, input.alpha, input.beta, input.uniform);
+		check(probs==expected, "getProbs of reference matches oracle");
+		//expanding the node at once must match entering each child symbol into a copy of the context
+		std::vector<std::vector<unsigned int> > expectedChildProbs(childSymbols.size()), childProbs;
+		for (size_t i = 0; i<childSymbols.size(); i++) {
+			PPMLanguageModel::Context child = reference.cloneContext(context);
+			reference.enterSymbol(child, childSymbols[i]);
+			reference.getProbs(child, expectedChildProbs[i], input.alpha, input.beta, input.uniform);
+			checkDistribution(expectedChildProbs[i], input);
+			reference.releaseContext(child);
+			OracleModel::Context oracleChild = oracleContext;
+			oracle.enterSymbol(oracleChild, childSymbols[i]);
+			oracle.getProbs(oracleChild, probs, input.alpha, input.beta, input.uniform);
+			check(probs==expectedChildProbs[i], "getProbs of reference's child matches oracle");
+		}
+		reference.getChildDistributions(context, childSymbols, childProbs, input.alpha, input.beta, input.uniform,
+				buffer);
+		check(childProbs==expectedChildProbs, "getChildDistributions of reference");
+		reference.releaseContext(context);
+		reference.getProbsAfter(contextSymbols.empty() ? NULL : &contextSymbols[0], contextSymbols.size(), probs,
+				input.alpha, input.beta, input.uniform);
+		check(probs==expected, "getProbsAfter of reference");
+		for (size_t v = 0; v<variants.size(); v++) {
+			currentCase+=", variant "+names[v];
+			PPMLanguageModel* variant = variants[v];
+			context=variant->createEmptyContext();
+			for (size_t i = 0; i<contextSymbols.size(); i++) variant->enterSymbol(context, contextSymbols[i]);
+			variant->getProbs(context, probs, input.alpha, input.beta, input.uniform);
+			check(probs==expected, "getProbs");
+			variant->getChildDistributions(context, childSymbols, childProbs, input.alpha, input.beta, input.uniform,
+					buffer);
+			check(childProbs==expectedChildProbs, "getChildDistributions");
+			variant->releaseContext(context);
+			variant->getProbsAfter(contextSymbols.empty() ? NULL : &contextSymbols[0], contextSymbols.size(), probs,
+					input.alpha, input.beta, input.uniform);
+			check(probs==expected, "getProbsAfter");
+			currentCase.resize(currentCase.rfind(", variant"));
+		}
+	}
+	for (size_t v = 0; v<variants.size(); v++) delete variants[v];
+}
+
+static void checkSuffixArray(const SuffixArrayLanguageModel& model, SuffixArrayLanguageModel::Context context,
+		const NaiveSubstringModel& naive, const std::vector<Symbol>& history, const ModelInput& input) {
+	std::vector<unsigned int> probs, expected;
+	model.getProbs(context, probs, input.alpha, input.beta, input.uniform);
+	checkDistribution(probs, input);
+	naive.getProbs(history, expected, input.alpha, input.beta, input.uniform);
+	check(probs==expected, "getProbs of suffix array matches naive substring counts");
+}
+
+//Learns the input's sequences into a SuffixArrayLanguageModel, mostly in one context (a fresh one for each
+//sequence), but also in two others, where symbols are entered too, and queries all three in between. Long
+//inputs cross several rebuilds of the index (every 4096 symbols), short ones those when the text doubles.
+//maxOrder 7 stands for unbounded order.
+static void fuzzSuffixArray(const uint8_t* data, size_t size) {
+	ModelInput input(data, size);
+	int maxOrder = (input.maxOrder==7) ? (1<<30) : input.maxOrder;
+	SuffixArrayLanguageModel model(input.numOfSymbols, maxOrder);
+	NaiveSubstringModel naive(input.numOfSymbols, maxOrder);
+	QueryRandom random(data, size);
+	std::vector<SuffixArrayLanguageModel::Context> contexts(3);
+	std::vector<std::vector<Symbol> > histories(contexts.size());
+	for (size_t c = 0; c<contexts.size(); c++) contexts[c]=model.createEmptyContext();
+	size_t length = 0;
+	for (size_t i = 0; i<input.sequences.size(); i++) length+=input.sequences[i].size();
+	int queryInterval = 1+length/40; //about 40 queries, as the oracle scans the whole text for each
+	for (size_t i = 0; i<=input.sequences.size(); i++) {
+		for (size_t c = 0; c<contexts.size(); c++) //query all contexts between sequences
+			checkSuffixArray(model, contexts[c], naive, histories[c], input);
+		if (i==input.sequences.size()) break;
+		model.releaseContext(contexts[0]);
+		naive.releaseContext(0);
+		contexts[0]=model.createEmptyContext();
+		histories[0].clear();
+		const std::vector<Symbol>& sequence = input.sequences[i];
+		for (size_t j = 0; j<sequence.size(); j++) {
+			int action = random.next(10);
+			int c = (action<7) ? 0 : 1+random.next(contexts.size()-1);
+			if (action<8) {
+				model.learnSymbol(contexts[c], sequence[j]);
+				naive.learnSymbol(c, histories[c], sequence[j]);
+			} else {
+				model.enterSymbol(contexts[c], sequence[j]);
+				if (sequence[j]!=0) histories[c].push_back(sequence[j]);
+			}
+			if (random.next(500)==0) {
+				model.releaseContext(contexts[c]);
+				naive.releaseContext(c);
+				contexts[c]=model.createEmptyContext();
+				histories[c].clear();
+			}
+			if (random.next(queryInterval)==0) {
+				c=random.next(contexts.size());
+				checkSuffixArray(model, contexts[c], naive, histories[c], input);
+			}
+		}
+	}
+	for (size_t c = 0; c<contexts.size(); c++) model.releaseContext(contexts[c]);
+}
+
+//Characters (symbols 1...) and multi-character tokens (following them) for the SymbolStream checks
+static const char* characters[] = {"a", "b", "c", "x", "y", "z", " ", "\r", "\n", "\xc3\xa9", "\xe2\x82\xac",
+		"\xf0\x9f\x98\x80"}; //e acute, euro sign, emoji
+static const char* tokens[] = {"ab", "abc", "xyz", "\r\n", "a \xc3\xa9", "\xc3\xa9\xe2\x82\xac",
+		"\xf0\x9f\x98\x80\xf0\x9f\x98\x80", "zzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzz"};
+#define NUM_OF_CHARACTERS (int) (sizeof(characters)/sizeof(*characters))
+#define NUM_OF_TOKENS (int) (sizeof(tokens)/sizeof(*tokens))
+
+template <typename Map>
+static std::vector<Symbol> readSymbols(const std::string& text, const Map* map) {
+	std::istringstream in(text);
+	SymbolStream symbolStream(in);
+	std::vector<Symbol> symbols;
+	for (Symbol symbol; (symbol=symbolStream.next(map))!=-1;) symbols.push_back(symbol);
+	return symbols;
+}
+
+//Splits the text into characters (AlphabetMap) and into tokens (TokenMap); replacing each token by its
+//characters must give the same sequence, i.e. tokenizing never loses, reorders or splits characters
+static void fuzzSymbolStreams(const uint8_t* data, size_t size) {
+	std::string text(data, data+size);
+	AlphabetMap alphabetMap;
+	TokenMap characterMap;
+	TokenMap tokenMap;
+	for (int i = 0; i<NUM_OF_CHARACTERS; i++) {
+		alphabetMap.add(characters[i], i+1);
+		characterMap.add(characters[i], i+1);
+		tokenMap.add(characters[i], i+1);
+	}
+	std::vector<std::vector<Symbol> > expansions(1, std::vector<Symbol>(1, 0)); //unknown stays unknown
+	for (int i = 0; i<NUM_OF_CHARACTERS; i++) expansions.push_back(std::vector<Symbol>(1, i+1));
+	for (int i = 0; i<NUM_OF_TOKENS; i++) {
+		tokenMap.add(tokens[i], NUM_OF_CHARACTERS+i+1);
+		expansions.push_back(readSymbols(tokens[i], &alphabetMap));
+	}
+	std::vector<Symbol> symbols = readSymbols(text, &alphabetMap);
+	for (size_t i = 0; i<symbols.size(); i++)
+		check(symbols[i]>=0 && symbols[i]<=NUM_OF_CHARACTERS, "symbol from AlphabetMap in range");
+	check(readSymbols(text, &characterMap)==symbols, "TokenMap of single characters agrees with AlphabetMap");
+	std::vector<Symbol> tokenSymbols = readSymbols(text, &tokenMap);
+	std::vector<Symbol> expanded;
+	for (size_t i = 0; i<tokenSymbols.size(); i++) {
+		check(tokenSymbols[i]>=0 && tokenSymbols[i]<=NUM_OF_CHARACTERS+NUM_OF_TOKENS, "symbol from TokenMap in range");
+		expanded.insert(expanded.end(), expansions[tokenSymbols[i]].begin(), expansions[tokenSymbols[i]].end());
+	}
+	check(expanded==symbols, "tokens expand to the characters");
+}
+
+#ifdef DASHER_LIBFUZZER
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+	static bool stdoutDiscarded = false; //see main
+	if (!stdoutDiscarded) {
+		if (freopen("/dev/null", "w", stdout)==NULL) abort();
+		stdoutDiscarded=true;
+	}
+	fuzzModels(data, size);
+	fuzzSuffixArray(data, size);
+	fuzzSymbolStreams(data, size);
+	return 0;
+}
+
+#else
+
+//Stream of symbols in the encoding of ModelInput, in one of several styles that reach different layouts
+static void generateModelInput(std::vector<uint8_t>& data, unsigned int& seed) {
+	int sizeIndex = rand_r(&seed)%(sizeof(alphabetSizes)/sizeof(*alphabetSizes));
+	int numOfSymbols = alphabetSizes[sizeIndex];
+	data.push_back(sizeIndex);
+	for (int i = 0; i<4; i++) data.push_back(rand_r(&seed)%255);
+	int style = rand_r(&seed)%3;
+	//few different symbols fill nodes up to and beyond MAX_RUN and numSymbols/4 without creating too many nodes
+	int numOfUsedSymbols = 1+rand_r(&seed)%(style==2 ? 12 : numOfSymbols+1);
+	std::vector<int> usedSymbols;
+	for (int i = 0; i<numOfUsedSymbols; i++) usedSymbols.push_back(rand_r(&seed)%(numOfSymbols+1));
+	int length = rand_r(&seed)%(rand_r(&seed)%2==0 ? 200 : 20000);
+	for (int i = 0; i<length; i++) {
+		if (rand_r(&seed)%500==0) {
+			data.push_back(255); //new context
+			continue;
+		}
+		int symbol;
+		if (style==0) symbol=rand_r(&seed)%(numOfSymbols+1);
+		else { //skewed towards the first used symbols
+			double r = rand_r(&seed)/(RAND_MAX+1.0);
+			symbol=usedSymbols[static_cast<int>(r*r*r*numOfUsedSymbols)];
+		}
+		if (numOfSymbols>=255) {
+			data.push_back(symbol>>8); //never 255, as symbols are below 4096
+			data.push_back(symbol&0xff);
+		} else data.push_back(symbol==255 ? 0 : symbol);
+	}
+}
+
+//Text made of alphabet characters, tokens, random bytes and cut off UTF-8 sequences
+static void generateText(std::vector<uint8_t>& data, unsigned int& seed) {
+	int length = rand_r(&seed)%(rand_r(&seed)%2==0 ? 50 : 5000);
+	for (int i = 0; i<length; i++) {
+		int kind = rand_r(&seed)%10;
+		std::string piece;
+		if (kind<5) piece=characters[rand_r(&seed)%NUM_OF_CHARACTERS];
+		else if (kind<8) piece=tokens[rand_r(&seed)%NUM_OF_TOKENS];
+		else if (kind<9) piece=std::string(1, static_cast<char>(rand_r(&seed)%256));
+		else {
+			piece=characters[NUM_OF_CHARACTERS-1-rand_r(&seed)%3]; //a multi-byte character...
+			piece.resize(rand_r(&seed)%piece.length()); //...cut short
+		}
+		data.insert(data.end(), piece.begin(), piece.end());
+	}
+}
+
+int main(int argc, char** argv) {
+	int iterations = argc>1 ? atoi(argv[1]) : 1000;
+	unsigned int seed = argc>2 ? atoi(argv[2]) : 1;
+	if (freopen("/dev/null", "w", stdout)==NULL) return 1;
+	for (int i = 0; i<iterations; i++) {
+		unsigned int caseSeed = seed+i;
+		char description[64];
+		snprintf(description, sizeof(description), "iteration %i, seed %u", i, caseSeed);
+		currentCase=description;
+		std::vector<uint8_t> data;
+		generateModelInput(data, caseSeed);
+		fuzzModels(data.empty() ? NULL : &data[0], data.size());
+		fuzzSuffixArray(data.empty() ? NULL : &data[0], data.size());
+		data.clear();
+		generateText(data, caseSeed);
+		fuzzSymbolStreams(data.empty() ? NULL : &data[0], data.size());
+		if ((i+1)%100==0) fprintf(stderr, "%i iterations passed\n", i+1);
+	}
+	fprintf(stderr, "All %i iterations passed\n", iterations);
+	return 0;
+}
+
+#endif
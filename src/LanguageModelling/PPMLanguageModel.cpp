@@ -4,20 +4,72 @@
 #include <stdint.h>
 #include <string.h> //for memset
 #include <set>
+#include <deque>
+#include <map>
+#include <utility>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <stdio.h>
+#include <limits.h> //for INT_MIN, USHRT_MAX
+#include <new> //for operator new
 
 #define MAX_RUN 4
+#define BITMAP_SLOTS INT_MIN //numOfChildSlots of nodes whose children are in a ChildBitmap
+#define NORMALIZATION (1<<16) //from CDasherModel
+#define SNAPSHOT_MAGIC 0x4d4c5044 //"DPLM"
+#define SNAPSHOT_VERSION 1
 
 using namespace Dasher;
 
-PPMLanguageModel::PPMLanguageModel(int numOfSymbols, int maxOrder) :
-		numOfSymbols(numOfSymbols), maxOrder(maxOrder), root(new PPMNode(-1)),
+//Slot of an inline hash where the child with 'symbol' is looked for first. Multiplying by 2^32 divided by
+//the golden ratio spreads consecutive symbols (e.g. the most frequent ones after remapSymbolsByFrequency)
+//evenly over the slots; with symbol%numOfSlots they would fill adjacent slots, i.e. runs longer than MAX_RUN.
+static inline int getHomeSlot(Symbol symbol, int numOfSlots) {
+	return (static_cast<uint64_t>(static_cast<uint32_t>(symbol)*2654435769u)*numOfSlots)>>32;
+}
+
+PPMLanguageModel::PPMLanguageModel(int numOfSymbols, int maxOrder, DenseChildStorage denseChildStorage) :
+		numOfSymbols(numOfSymbols), maxOrder(maxOrder), denseChildStorage(denseChildStorage), root(new PPMNode(-1)),
 		contextAllocator(1024), numOfNodesAllocated(1), //count root node
-		nodeAllocator(8192) {
+		nodeAllocator(8192), toInternal(numOfSymbols+1), toExternal(numOfSymbols+1),
+		symbolFrequencies(numOfSymbols+1, 0) {
+	for (Symbol symbol = 0; symbol<=numOfSymbols; symbol++) {
+		toInternal[symbol]=symbol;
+		toExternal[symbol]=symbol;
+	}
 	rootContext=contextAllocator.allocate();
 	rootContext->head=root;
 	rootContext->order=0;
 }
 
+PPMLanguageModel::~PPMLanguageModel() {
+	delete root; //all other nodes are freed with nodeAllocator
+}
+
+PPMLanguageModel* PPMLanguageModel::clone() const {
+	PPMLanguageModel* copy = new PPMLanguageModel(numOfSymbols, maxOrder, denseChildStorage);
+	copy->toInternal=toInternal;
+	copy->toExternal=toExternal;
+	copy->symbolFrequencies=symbolFrequencies;
+	//Breadth first: the vine of a node's child with symbol s is the child with symbol s of the node's vine,
+	//which is one level further up and has therefore already been copied
+	std::deque<std::pair<const PPMNode*, PPMNode*> > queue;
+	queue.push_back(std::make_pair(root, copy->root));
+	while (!queue.empty()) {
+		const PPMNode* from = queue.front().first;
+		PPMNode* to = queue.front().second;
+		queue.pop_front();
+		to->copyChildrenFrom(*from, *copy);
+		for (ChildIterator symbolIterator = to->children(); symbolIterator!=to->end(); symbolIterator.next()) {
+			PPMNode* child = *symbolIterator;
+			child->vine=(to==copy->root ? copy->root : to->vine->findSymbol(child->symbol));
+			queue.push_back(std::make_pair(from->findSymbol(child->symbol), child));
+		}
+	}
+	return copy;
+}
+
 PPMLanguageModel::Context PPMLanguageModel::createEmptyContext() {
 	PPMContext* allocatedContext = contextAllocator.allocate();
 	*allocatedContext=*rootContext;
@@ -25,6 +77,13 @@ PPMLanguageModel::Context PPMLanguageModel::createEmptyContext() {
 	return (Context) allocatedContext;
 }
 
+PPMLanguageModel::Context PPMLanguageModel::cloneContext(Context context) {
+	PPMContext* allocatedContext = contextAllocator.allocate();
+	*allocatedContext=*(PPMContext*) context;
+	setOfContexts.insert(allocatedContext);
+	return (Context) allocatedContext;
+}
+
 void PPMLanguageModel::releaseContext(Context release) {
 	setOfContexts.erase(setOfContexts.find((PPMContext*) release));
 	contextAllocator.free((PPMContext*) release);
@@ -32,9 +91,13 @@ void PPMLanguageModel::releaseContext(Context release) {
 
 //Update context with symbol 'symbol'
 void PPMLanguageModel::enterSymbol(Context c, Symbol symbol) {
+	enterSymbol(*(PPMContext*) c, symbol);
+}
+
+void PPMLanguageModel::enterSymbol(PPMContext& context, Symbol symbol) const {
 	if (symbol==0) return;
 	//DASHER_ASSERT(symbol>=0 && symbol<GetSize());
-	PPMContext& context = *(PPMContext*) c;
+	symbol=toInternal[symbol];
 	while (true) {
 		if (context.order<maxOrder) { //Only try to extend the context if it's not going to make it too long
 			PPMNode* find = context.head->findSymbol(symbol);
@@ -58,6 +121,8 @@ void PPMLanguageModel::enterSymbol(Context c, Symbol symbol) {
 void PPMLanguageModel::learnSymbol(Context c, Symbol symbol) {
 	if (symbol==0) return;
 	//DASHER_ASSERT(symbol>=0 && symbol<GetSize());
+	symbolFrequencies[symbol]++;
+	symbol=toInternal[symbol];
 	PPMContext& context = *(PPMContext*) c;
 	PPMNode* node = addSymbolToNode(context.head, symbol);
 	//DASHER_ASSERT(node==context.head->findSymbol(symbol));
@@ -71,25 +136,90 @@ void PPMLanguageModel::learnSymbol(Context c, Symbol symbol) {
 
 //Get the probability distribution at the context
 void PPMLanguageModel::getProbs(Context context, std::vector<unsigned int>& probs, int alpha, int beta, int uniform) const {
+	const PPMContext* ppmContext = (const PPMContext*) context;
+	//DASHER_ASSERT(isValidContext(context)); //method removed, simply checked whether setOfContexts contains context
+	getProbsAtNode(ppmContext->head, -1, probs, alpha, beta, uniform);
+}
+
+void PPMLanguageModel::getProbsAfter(const Symbol* contextSymbols, int length, std::vector<unsigned int>& probs,
+		int alpha, int beta, int uniform) const {
+	PPMContext context = *rootContext; //unregistered, on the stack
+	for (int i = 0; i<length; i++)
+		enterSymbol(context, contextSymbols[i]);
+	getProbs((Context) &context, probs, alpha, beta, uniform);
+}
+
+//Expand a whole node: the distributions of all children of 'parent' listed in 'childSymbols'
+void PPMLanguageModel::getChildDistributions(Context parent, const std::vector<Symbol>& childSymbols,
+		std::vector<std::vector<unsigned int> >& childProbs, int alpha, int beta, int uniform,
+		ExpansionBuffer& buffer) const {
+	const PPMContext* ppmContext = (const PPMContext*) parent;
+	std::vector<const PPMNode*>& childHeads = buffer.childHeads;
+	//Entering symbol s moves the head to child s of the first node on the parent's vine chain (which is
+	//allowed to grow) that has one, or leaves it at the root if there is none. A single pass over the
+	//children of the nodes on the parent's chain therefore finds the new heads of all symbols at once,
+	//instead of calling findSymbol per symbol and level; each distribution then follows from its head.
+	childHeads.assign(numOfSymbols+1, NULL);
+	int order = ppmContext->order;
+	for (const PPMNode* temp = ppmContext->head; temp!=NULL; temp=temp->vine, order--) {
+		if (order>=maxOrder) continue;
+		for (ChildIterator symbolIterator = temp->children(), childrenEnd = temp->end(); symbolIterator!=childrenEnd;
+				symbolIterator.next()) {
+			if (childHeads[(*symbolIterator)->symbol]==NULL) childHeads[(*symbolIterator)->symbol]=*symbolIterator;
+		}
+	}
+	//The root is at the end of every chain; sum its children's counts only once
+	int rootTotal = 0;
+	for (ChildIterator symbolIterator = root->children(); symbolIterator!=root->end(); symbolIterator.next())
+		rootTotal+=(*symbolIterator)->count;
+	childProbs.resize(childSymbols.size());
+	int rootOnly = -1; //first child left at the root; all others found nowhere share its distribution
+	for (size_t i = 0; i<childSymbols.size(); i++) {
+		Symbol symbol = childSymbols[i];
+		//DASHER_ASSERT(symbol>=0 && symbol<=numOfSymbols);
+		const PPMNode* head = (symbol==0 ? ppmContext->head : childHeads[toInternal[symbol]]);
+		if (head!=NULL) getProbsAtNode(head, rootTotal, childProbs[i], alpha, beta, uniform);
+		else if (rootOnly>=0) childProbs[i]=childProbs[rootOnly];
+		else {
+			rootOnly=i;
+			getProbsAtNode(root, rootTotal, childProbs[i], alpha, beta, uniform);
+		}
+	}
+}
+
+int PPMLanguageModel::getNumOfSymbols() const {
+	return numOfSymbols;
+}
+
+int PPMLanguageModel::getNumOfNodesAllocated() const {
+	return numOfNodesAllocated;
+}
+
+void PPMLanguageModel::getProbsAtNode(const PPMNode* head, int rootTotal, std::vector<unsigned int>& probs,
+		int alpha, int beta, int uniform) const {
 	//adapted from CAlphabetManager::GetProbs
-	static const int NORMALIZATION = 1<<16; //from CDasherModel
 	int uniformAdd = std::max(1, NORMALIZATION*uniform/1000/numOfSymbols);
 	int norm = NORMALIZATION-numOfSymbols*uniformAdd; //non-uniform norm
 	//
-	const PPMContext* ppmContext = (const PPMContext*) context;
-	//DASHER_ASSERT(isValidContext(context)); //method removed, simply checked whether setOfContexts contains context
 	probs.assign(numOfSymbols+1, 0);
 	unsigned int toSpend = norm;
-	for (PPMNode* temp = ppmContext->head; temp!=NULL; temp=temp->vine) {
-		int total = 0;
-		for (ChildIterator symbolIterator = temp->children(); symbolIterator!=temp->end(); symbolIterator.next()) {
-			total+=(*symbolIterator)->count;
+	//end() is taken once per node: the stores to 'probs' may alias the node's fields, so a loop condition
+	//calling end() is evaluated anew for every child, which costs a ChildBitmap an extra header load each time
+	for (const PPMNode* temp = head; temp!=NULL; temp=temp->vine) {
+		int total = (temp==root ? rootTotal : -1);
+		if (total<0) {
+			total=0;
+			for (ChildIterator symbolIterator = temp->children(), childrenEnd = temp->end(); symbolIterator!=childrenEnd;
+					symbolIterator.next()) {
+				total+=(*symbolIterator)->count;
+			}
 		}
 		if (total!=0) {
 			unsigned int sizeOfSlice = toSpend;
-			for (ChildIterator symbolIterator = temp->children(); symbolIterator!=temp->end(); symbolIterator.next()) {
+			for (ChildIterator symbolIterator = temp->children(), childrenEnd = temp->end(); symbolIterator!=childrenEnd;
+					symbolIterator.next()) {
 				unsigned int p = static_cast<int64_t>(sizeOfSlice)*(100*(*symbolIterator)->count-beta)/(100*total+alpha);
-				probs[(*symbolIterator)->symbol]+=p;
+				probs[toExternal[(*symbolIterator)->symbol]]+=p;
 				toSpend-=p;
 				//printf("symbol %u counts %d p %u toSpend %u \n", symbol, s->count, p, toSpend);
 			}
@@ -113,8 +243,171 @@ void PPMLanguageModel::getProbs(Context context, std::vector<unsigned int>& prob
 	//DASHER_ASSERT(toSpend==0);
 }
 
-int PPMLanguageModel::getNumOfNodesAllocated() const {
-	return numOfNodesAllocated;
+//Snapshot format (native byte order): the header, toExternal, symbolFrequencies, then one record per node
+//(symbol, count, number of children) in breadth first order, starting with the root.
+//Vines aren't stored, they follow from the tree (see clone).
+bool PPMLanguageModel::writeToFile(const std::string& fileName) const {
+	std::ofstream out(fileName.c_str(), std::ios::binary);
+	if (!out) return false;
+	int32_t header[] = {SNAPSHOT_MAGIC, SNAPSHOT_VERSION, numOfSymbols, maxOrder, numOfNodesAllocated};
+	out.write((const char*) header, sizeof(header));
+	for (int i = 0; i<=numOfSymbols; i++) {
+		int32_t entry[] = {toExternal[i], static_cast<int32_t>(symbolFrequencies[i])};
+		out.write((const char*) entry, sizeof(entry));
+	}
+	std::deque<const PPMNode*> queue(1, root);
+	while (!queue.empty()) {
+		const PPMNode* node = queue.front();
+		queue.pop_front();
+		int32_t record[] = {node->symbol, node->count, 0};
+		for (ChildIterator symbolIterator = node->children(); symbolIterator!=node->end(); symbolIterator.next()) {
+			record[2]++;
+			queue.push_back(*symbolIterator);
+		}
+		out.write((const char*) record, sizeof(record));
+	}
+	return out.good();
+}
+
+PPMLanguageModel* PPMLanguageModel::readFromFile(const std::string& fileName, DenseChildStorage denseChildStorage,
+		std::string* error) {
+	std::ifstream in(fileName.c_str(), std::ios::binary);
+	int32_t header[5];
+	if (!in.read((char*) header, sizeof(header)) || header[0]!=SNAPSHOT_MAGIC || header[1]!=SNAPSHOT_VERSION) {
+		if (error!=NULL) *error=fileName+" is not a language model snapshot";
+		return NULL;
+	}
+	if (header[2]<=0 || header[2]>MAX_NUM_OF_SYMBOLS || header[3]<0) {
+		if (error!=NULL) {
+			std::ostringstream message;
+			message << "Snapshot " << fileName << " has " << header[2] << " symbols and order " << header[3];
+			*error=message.str();
+		}
+		return NULL;
+	}
+	PPMLanguageModel* model = new PPMLanguageModel(header[2], header[3], denseChildStorage);
+	//the symbol numbering must be a permutation that keeps 0 (unknown symbol) at 0
+	std::vector<bool> seen(model->numOfSymbols+1, false);
+	bool valid = true;
+	for (int i = 0; valid && i<=model->numOfSymbols; i++) {
+		int32_t entry[2];
+		valid=in.read((char*) entry, sizeof(entry)) && entry[0]>=0 && entry[0]<=model->numOfSymbols
+				&& !seen[entry[0]] && (entry[0]==0)==(i==0);
+		if (valid) {
+			seen[entry[0]]=true;
+			model->toExternal[i]=entry[0];
+			model->toInternal[entry[0]]=i;
+			model->symbolFrequencies[i]=entry[1];
+		}
+	}
+	//rebuild breadth first, like clone: children are read right after their parent's remaining siblings
+	int32_t record[3] = {0, 0, 0};
+	valid=valid && in.read((char*) record, sizeof(record)) && record[2]>=0;
+	std::deque<std::pair<PPMNode*, int> > queue(1, std::make_pair(model->root, record[2]));
+	while (valid && !queue.empty()) {
+		PPMNode* node = queue.front().first;
+		int numOfChildren = queue.front().second;
+		queue.pop_front();
+		for (int i = 0; valid && i<numOfChildren; i++) {
+			valid=in.read((char*) record, sizeof(record)) && record[0]>=1 && record[0]<=model->numOfSymbols
+					&& record[1]>=1 && record[1]<=USHRT_MAX && record[2]>=0 && node->findSymbol(record[0])==NULL;
+			if (!valid) break;
+			PPMNode* child = model->makeNode(record[0]);
+			child->count=record[1];
+			node->addChild(child, model->numOfSymbols+1, denseChildStorage==BITMAP_RANKED_CHILDREN);
+			//the vine's node is one level up and complete, so a missing vine means an inconsistent tree
+			child->vine=(node==model->root ? model->root : node->vine->findSymbol(child->symbol));
+			valid=(child->vine!=NULL);
+			queue.push_back(std::make_pair(child, record[2]));
+		}
+	}
+	if (!valid || model->numOfNodesAllocated!=header[4]) {
+		if (error!=NULL) *error="Snapshot "+fileName+" is truncated or corrupt";
+		delete model;
+		return NULL;
+	}
+	return model;
+}
+
+size_t PPMLanguageModel::getMemoryUsage() const {
+	return numOfNodesAllocated*sizeof(PPMNode)+getChildArrayMemoryUsage(root);
+}
+
+size_t PPMLanguageModel::getChildArrayMemoryUsage(const PPMNode* node) const {
+	size_t result = node->getChildArrayMemoryUsage();
+	for (ChildIterator symbolIterator = node->children(); symbolIterator!=node->end(); symbolIterator.next())
+		result+=getChildArrayMemoryUsage(*symbolIterator);
+	return result;
+}
+
+void PPMLanguageModel::remapSymbolsByFrequency() {
+	//new internal numbers: 1 for the most frequent symbol, 2 for the next one, ...
+	std::vector<std::pair<long long, Symbol> > byFrequency;
+	for (Symbol symbol = 1; symbol<=numOfSymbols; symbol++) //negated, so most frequent first
+		byFrequency.push_back(std::make_pair(-static_cast<long long>(symbolFrequencies[symbol]), symbol));
+	std::sort(byFrequency.begin(), byFrequency.end());
+	std::vector<Symbol> newSymbols(numOfSymbols+1, 0); //old internal number -> new internal number
+	for (Symbol newSymbol = 1; newSymbol<=numOfSymbols; newSymbol++) {
+		Symbol symbol = byFrequency[newSymbol-1].second;
+		newSymbols[toInternal[symbol]]=newSymbol;
+		toInternal[symbol]=newSymbol;
+		toExternal[newSymbol]=symbol;
+	}
+	//every node except the root is a child of exactly one node, so renumber each node's children
+	std::vector<PPMNode*> stack(1, root);
+	while (!stack.empty()) {
+		PPMNode* node = stack.back();
+		stack.pop_back();
+		node->renumberChildren(newSymbols, numOfSymbols+1, denseChildStorage==BITMAP_RANKED_CHILDREN);
+		for (ChildIterator symbolIterator = node->children(); symbolIterator!=node->end(); symbolIterator.next())
+			stack.push_back(*symbolIterator);
+	}
+}
+
+bool PPMLanguageModel::hasSameTree(const PPMLanguageModel& other) const {
+	if (numOfSymbols!=other.numOfSymbols || maxOrder!=other.maxOrder || numOfNodesAllocated!=other.numOfNodesAllocated)
+		return false;
+	//Breadth first over both trees, pairing each node with its counterpart in 'other'. Vines point one level
+	//up, and all nodes of that level have been paired by the time their children are visited.
+	std::map<const PPMNode*, const PPMNode*> counterparts;
+	counterparts[root]=other.root;
+	std::deque<std::pair<const PPMNode*, const PPMNode*> > queue;
+	queue.push_back(std::make_pair(root, other.root));
+	while (!queue.empty()) {
+		const PPMNode* node = queue.front().first;
+		const PPMNode* otherNode = queue.front().second;
+		queue.pop_front();
+		if (node->count!=otherNode->count) return false;
+		int numOfChildren = 0;
+		for (ChildIterator symbolIterator = node->children(); symbolIterator!=node->end(); symbolIterator.next()) {
+			const PPMNode* child = *symbolIterator;
+			const PPMNode* otherChild = otherNode->findSymbol(other.toInternal[toExternal[child->symbol]]);
+			if (node->findSymbol(child->symbol)!=child || otherChild==NULL) return false;
+			std::map<const PPMNode*, const PPMNode*>::const_iterator vine = counterparts.find(child->vine);
+			if (vine==counterparts.end() || vine->second!=otherChild->vine) return false;
+			counterparts[child]=otherChild;
+			queue.push_back(std::make_pair(child, otherChild));
+			numOfChildren++;
+		}
+		for (ChildIterator symbolIterator = otherNode->children(); symbolIterator!=otherNode->end(); symbolIterator.next())
+			numOfChildren--;
+		if (numOfChildren!=0) return false;
+	}
+	return true;
+}
+
+PPMLanguageModel::LayoutStats PPMLanguageModel::getLayoutStats() const {
+	LayoutStats stats;
+	std::vector<const PPMNode*> stack(1, root);
+	while (!stack.empty()) {
+		const PPMNode* node = stack.back();
+		stack.pop_back();
+		node->addLayoutStats(stats);
+		for (ChildIterator symbolIterator = node->children(); symbolIterator!=node->end(); symbolIterator.next())
+			stack.push_back(*symbolIterator);
+	}
+	stats.memoryUsage=getMemoryUsage();
+	return stats;
 }
 
 PPMLanguageModel::PPMNode* PPMLanguageModel::makeNode(Symbol symbol) {
@@ -131,7 +424,7 @@ PPMLanguageModel::PPMNode* PPMLanguageModel::addSymbolToNode(PPMNode* node, Symb
 	} else {
 		//symbol does not exist at this level
 		returnVal=makeNode(symbol); //count initialized to 1 but no vine pointer
-		node->addChild(returnVal, numOfSymbols+1);
+		node->addChild(returnVal, numOfSymbols+1, denseChildStorage==BITMAP_RANKED_CHILDREN);
 		returnVal->vine=(node==root ? root : addSymbolToNode(node->vine, symbol));
 	}
 	return returnVal;
@@ -143,82 +436,226 @@ PPMLanguageModel::PPMNode::PPMNode(Symbol symbol) :
 }
 
 PPMLanguageModel::PPMNode::~PPMNode() {
+	deleteChildArray();
+}
+
+void PPMLanguageModel::PPMNode::deleteChildArray() {
+	if (numOfChildSlots==BITMAP_SLOTS) ChildBitmap::destroy(bitmap);
 	//single child = is direct pointer to node, not array...
-	if (numOfChildSlots!=1) delete[] childrenArray;
+	else if (numOfChildSlots!=1) delete[] childrenArray;
 }
 
 PPMLanguageModel::ChildIterator PPMLanguageModel::PPMNode::children() const {
+	//the packed array of a ChildBitmap has no gaps, so iterating it skips no empty slots at all
+	if (numOfChildSlots==BITMAP_SLOTS)
+		return ChildIterator(bitmap->getChildren()+bitmap->numOfChildren, bitmap->getChildren()-1);
 	//if numOfChildSlots = 0 / 1, 'childrenArray' is direct pointer, else pointer to array (of pointers)
 	PPMNode *const *ppChild = (numOfChildSlots==0 || numOfChildSlots==1) ? &child : childrenArray;
 	return ChildIterator(ppChild+abs(numOfChildSlots), ppChild-1);
 }
 
 const PPMLanguageModel::ChildIterator PPMLanguageModel::PPMNode::end() const {
+	if (numOfChildSlots==BITMAP_SLOTS) return ChildIterator(bitmap->getChildren(), bitmap->getChildren()-1);
 	//if numOfChildSlots = 0 / 1, 'childrenArray' is direct pointer, else pointer to array (of pointers)
 	PPMNode *const *ppChild = (numOfChildSlots==0 || numOfChildSlots==1) ? &child : childrenArray;
 	return ChildIterator(ppChild, ppChild-1);
 }
 
-void PPMLanguageModel::PPMNode::addChild(PPMNode* newChild, int numSymbols) {
+void PPMLanguageModel::PPMNode::addChild(PPMNode* newChild, int numSymbols, bool useBitmap) {
+	if (tryAddChild(newChild)) return;
+	//resize! collect children in the order they used to be re-added one by one, the new one last
+	std::vector<PPMNode*> allChildren;
+	for (ChildIterator symbolIterator = children(); symbolIterator!=end(); symbolIterator.next())
+		allChildren.push_back(*symbolIterator);
+	allChildren.push_back(newChild);
+	int slots = (numOfChildSlots==BITMAP_SLOTS) ? bitmap->numOfSymbols : abs(numOfChildSlots);
+	int oldNumOfDirectElems = (numOfChildSlots<0) ? -numOfChildSlots : 0;
+	deleteChildArray();
+	storeChildren(allChildren, slots, oldNumOfDirectElems, numSymbols, useBitmap);
+}
+
+void PPMLanguageModel::PPMNode::storeChildren(std::vector<PPMNode*>& allChildren, int slots, int oldNumOfDirectElems,
+		int numSymbols, bool useBitmap) {
+	int numOfChildren = allChildren.size();
+	Symbol maxSymbol = 0;
+	for (size_t i = 0; i<allChildren.size(); i++) maxSymbol=std::max(maxSymbol, allChildren[i]->symbol);
+	//Direct indexing only needs an array up to the largest symbol, which is short if symbols are numbered
+	//by frequency (see remapSymbolsByFrequency); it grows again if a larger symbol is added later, at
+	//least doubling so that adding children in ascending order doesn't copy the array for every one. Use
+	//it if the node has many children or the array wouldn't be longer than the grown hash.
+	while (std::max(slots, numOfChildren-1)<numSymbols/4) {
+		slots+=slots+1;
+		if (maxSymbol<slots) break;
+		numOfChildSlots=slots;
+		childrenArray=new PPMNode*[slots];
+		memset(childrenArray, 0, sizeof(PPMNode*)*slots);
+		size_t i = 0;
+		while (i<allChildren.size() && tryAddChild(allChildren[i])) i++;
+		if (i==allChildren.size()) return;
+		delete[] childrenArray; //a run got too long, try a larger hash
+	}
+	if (useBitmap) { //same decision as for direct indexing, just a different way to store the children
+		//a presence bit costs much less than a pointer, so cover the whole alphabet: a larger symbol is then
+		//inserted in place instead of rebuilding the bitmap, and only the packed array ever grows
+		numOfChildSlots=BITMAP_SLOTS;
+		bitmap=ChildBitmap::create(numSymbols, numOfChildren+numOfChildren/4+1);
+		std::sort(allChildren.begin(), allChildren.end(), hasSmallerSymbol); //so each insert appends
+		for (size_t i = 0; i<allChildren.size(); i++) bitmap->insert(allChildren[i]);
+		return;
+	}
+	int numOfDirectElems = std::max(maxSymbol+1, std::min(2*oldNumOfDirectElems, numSymbols));
+	numOfChildSlots=-numOfDirectElems; //negative = "use direct indexing"
+	childrenArray=new PPMNode*[numOfDirectElems];
+	memset(childrenArray, 0, sizeof(PPMNode*)*numOfDirectElems);
+	for (size_t i = 0; i<allChildren.size(); i++)
+		childrenArray[allChildren[i]->symbol]=allChildren[i];
+}
+
+bool PPMLanguageModel::PPMNode::tryAddChild(PPMNode* newChild) {
+	if (numOfChildSlots==BITMAP_SLOTS) {
+		if (!bitmap->insert(newChild)) {
+			ChildBitmap* grown = bitmap->copy(bitmap->capacity+bitmap->capacity/4+1);
+			ChildBitmap::destroy(bitmap);
+			bitmap=grown;
+			bitmap->insert(newChild);
+		}
+		return true;
+	}
 	if (numOfChildSlots<0) {
+		if (newChild->symbol>=-numOfChildSlots) return false; //short direct indexing array, see addChild
 		childrenArray[newChild->symbol]=newChild;
-	} else {
-		if (numOfChildSlots==0) {
-			numOfChildSlots=1;
-			child=newChild;
-			return;
-		} else if (numOfChildSlots==1) {
-			//no room, have to resize...
-		} else if (numOfChildSlots<=MAX_RUN) {
-			for (int i = 0; i<numOfChildSlots; i++)
-				if (childrenArray[i]==NULL) {
-					childrenArray[i]=newChild;
-					return;
-				}
-		} else {
-			Symbol start = newChild->symbol;
-			//find length of run (including to-be-inserted element)...
-			while (childrenArray[start=(start+numOfChildSlots-1)%numOfChildSlots]!=NULL);
-			Symbol idx = newChild->symbol;
-			while (childrenArray[idx%=numOfChildSlots]) idx++;
-			//found NULL
-			Symbol stop = idx;
-			while (childrenArray[stop=(stop+1)%numOfChildSlots]!=NULL);
-			//start and idx point to NULLs (with inserted element somewhere in between)
-			int runLen = (numOfChildSlots+stop-(start+1))%numOfChildSlots;
-			if (runLen<=MAX_RUN) {
-				//ok, maintain size
-				childrenArray[idx]=newChild;
-				return;
+		return true;
+	}
+	if (numOfChildSlots==0) {
+		numOfChildSlots=1;
+		child=newChild;
+		return true;
+	}
+	if (numOfChildSlots==1) return false; //no room
+	if (numOfChildSlots<=MAX_RUN) {
+		for (int i = 0; i<numOfChildSlots; i++)
+			if (childrenArray[i]==NULL) {
+				childrenArray[i]=newChild;
+				return true;
 			}
+		return false;
+	}
+	Symbol start = getHomeSlot(newChild->symbol, numOfChildSlots);
+	//find length of run (including to-be-inserted element)...
+	while (childrenArray[start=(start+numOfChildSlots-1)%numOfChildSlots]!=NULL);
+	Symbol idx = getHomeSlot(newChild->symbol, numOfChildSlots);
+	while (childrenArray[idx%=numOfChildSlots]) idx++;
+	//found NULL
+	Symbol stop = idx;
+	while (childrenArray[stop=(stop+1)%numOfChildSlots]!=NULL);
+	//start and idx point to NULLs (with inserted element somewhere in between)
+	int runLen = (numOfChildSlots+stop-(start+1))%numOfChildSlots;
+	if (runLen>MAX_RUN) return false;
+	//ok, maintain size
+	childrenArray[idx]=newChild;
+	return true;
+}
+
+void PPMLanguageModel::PPMNode::copyChildrenFrom(const PPMNode& other, PPMLanguageModel& model) {
+	numOfChildSlots=other.numOfChildSlots;
+	if (numOfChildSlots==0) return;
+	if (numOfChildSlots==BITMAP_SLOTS) {
+		bitmap=other.bitmap->copy(other.bitmap->capacity);
+		PPMNode** children = bitmap->getChildren();
+		for (int i = 0; i<bitmap->numOfChildren; i++) {
+			children[i]=model.makeNode(children[i]->symbol);
+			children[i]->count=other.bitmap->getChildren()[i]->count;
 		}
-		//resize!
-		PPMNode** oldChildrenArray = childrenArray;
-		int oldSlots = numOfChildSlots;
-		int newNumElems;
-		if (numOfChildSlots>=numSymbols/4) {
-			numOfChildSlots=-numSymbols; //negative = "use direct indexing"
-			newNumElems=numSymbols;
-		} else {
-			numOfChildSlots+=numOfChildSlots+1;
-			newNumElems=numOfChildSlots;
-		}
-		childrenArray=new PPMNode*[newNumElems]; //null terminator
-		memset(childrenArray, 0, sizeof(PPMNode*)*newNumElems);
-		if (oldSlots==1) addChild((PPMNode*) oldChildrenArray, numSymbols);
-		else {
-			while (oldSlots-->0)
-				if (oldChildrenArray[oldSlots]) addChild(oldChildrenArray[oldSlots], numSymbols);
-			delete[] oldChildrenArray;
+		return;
+	}
+	if (numOfChildSlots==1) {
+		child=model.makeNode(other.child->symbol);
+		child->count=other.child->count;
+		return;
+	}
+	int size = abs(numOfChildSlots);
+	childrenArray=new PPMNode*[size];
+	for (int i = 0; i<size; i++) {
+		if (other.childrenArray[i]==NULL) {
+			childrenArray[i]=NULL;
+			continue;
 		}
-		addChild(newChild, numSymbols);
+		childrenArray[i]=model.makeNode(other.childrenArray[i]->symbol);
+		childrenArray[i]->count=other.childrenArray[i]->count;
+	}
+}
+
+int PPMLanguageModel::PPMNode::getChildArraySize() const {
+	//DASHER_ASSERT(numOfChildSlots!=BITMAP_SLOTS);
+	//0 / 1 slots are stored in the node itself ('child')
+	return (numOfChildSlots==0 || numOfChildSlots==1) ? 0 : abs(numOfChildSlots);
+}
+
+size_t PPMLanguageModel::PPMNode::getChildArrayMemoryUsage() const {
+	if (numOfChildSlots==BITMAP_SLOTS) return ChildBitmap::getSize(bitmap->numOfSymbols, bitmap->capacity);
+	return getChildArraySize()*sizeof(PPMNode*);
+}
+
+void PPMLanguageModel::PPMNode::renumberChildren(const std::vector<Symbol>& newSymbols, int numSymbols, bool useBitmap) {
+	std::vector<std::pair<Symbol, PPMNode*> > oldChildren;
+	for (ChildIterator symbolIterator = children(); symbolIterator!=end(); symbolIterator.next())
+		oldChildren.push_back(std::make_pair(newSymbols[(*symbolIterator)->symbol], *symbolIterator));
+	deleteChildArray();
+	numOfChildSlots=0;
+	childrenArray=NULL;
+	//store frequent symbols first, so they get their home slots in hashes
+	std::sort(oldChildren.begin(), oldChildren.end());
+	std::vector<PPMNode*> allChildren;
+	for (size_t i = 0; i<oldChildren.size(); i++) {
+		oldChildren[i].second->symbol=oldChildren[i].first;
+		allChildren.push_back(oldChildren[i].second);
+	}
+	//all children are known, so size the child array once for all of them, rather than growing it child by
+	//child (adding them by ascending symbol would make every node direct indexed that starts with a few
+	//small symbols)
+	if (allChildren.size()==1) tryAddChild(allChildren[0]);
+	else if (allChildren.size()>1) storeChildren(allChildren, 1, 0, numSymbols, useBitmap);
+}
+
+void PPMLanguageModel::PPMNode::addLayoutStats(LayoutStats& stats) const {
+	if (numOfChildSlots==0) return;
+	stats.numOfNodesWithChildren++;
+	if (numOfChildSlots==BITMAP_SLOTS) { //one word, its rank and the child for every child
+		stats.numOfBitmapNodes++;
+		stats.denseChildMemoryUsage+=getChildArrayMemoryUsage();
+		stats.numOfChildren+=bitmap->numOfChildren;
+		stats.numOfProbes+=bitmap->numOfChildren;
+		stats.maxProbes=std::max(stats.maxProbes, 1);
+		return;
 	}
+	if (numOfChildSlots<0) {
+		stats.numOfDirectIndexedNodes++;
+		stats.denseChildMemoryUsage+=getChildArrayMemoryUsage();
+	}
+	int size = getChildArraySize();
+	for (int i = 0; i<std::max(size, 1); i++) {
+		const PPMNode* found = (size==0) ? child : childrenArray[i];
+		if (found==NULL) continue;
+		//slots findSymbol reads for this child, see there
+		int probes = 1; //direct indexing or single child
+		if (numOfChildSlots>1 && numOfChildSlots<=MAX_RUN) probes=i+1;
+		else if (numOfChildSlots>MAX_RUN)
+			probes=(i-getHomeSlot(found->symbol, numOfChildSlots)+numOfChildSlots)%numOfChildSlots+1;
+		stats.numOfChildren++;
+		stats.numOfProbes+=probes;
+		stats.maxProbes=std::max(stats.maxProbes, probes);
+	}
+}
+
+bool PPMLanguageModel::PPMNode::hasSmallerSymbol(const PPMNode* a, const PPMNode* b) {
+	return a->symbol<b->symbol;
 }
 
 PPMLanguageModel::PPMNode* PPMLanguageModel::PPMNode::findSymbol(Symbol symbolToFind) const {
 	//see if symbol is a child of node
+	if (numOfChildSlots==BITMAP_SLOTS) return bitmap->find(symbolToFind);
 	if (numOfChildSlots<0) //negative to mean "full alphabet", use direct indexing
-		return childrenArray[symbolToFind];
+		return symbolToFind<-numOfChildSlots ? childrenArray[symbolToFind] : NULL;
 	if (numOfChildSlots==1) {
 		if (child->symbol==symbolToFind) return child;
 		return NULL;
@@ -229,10 +666,56 @@ PPMLanguageModel::PPMNode* PPMLanguageModel::PPMNode::findSymbol(Symbol symbolTo
 		return NULL;
 	}
 	//printf("finding symbol %d at node %d\n", symbol, node->id);
-	for (int i = symbolToFind;; i++) { //search through elements which have overflowed into subsequent slots
+	//search through elements which have overflowed into subsequent slots
+	for (int i = getHomeSlot(symbolToFind, numOfChildSlots);; i++) {
 		PPMNode* found = this->childrenArray[i%numOfChildSlots]; //wrap round
 		if (!found) return NULL; //null element
 		if (found->symbol==symbolToFind) return found;
 	}
 	return NULL;
 }
+
+PPMLanguageModel::ChildBitmap* PPMLanguageModel::ChildBitmap::create(int numOfSymbols, int capacity) {
+	ChildBitmap* bitmap = (ChildBitmap*) operator new(getSize(numOfSymbols, capacity));
+	bitmap->numOfSymbols=numOfSymbols;
+	bitmap->numOfChildren=0;
+	bitmap->capacity=capacity;
+	memset(bitmap->getWords(), 0, sizeof(uint64_t)*bitmap->getNumOfWords());
+	memset(bitmap->getRanks(), 0, sizeof(uint32_t)*bitmap->getNumOfWords());
+	return bitmap;
+}
+
+void PPMLanguageModel::ChildBitmap::destroy(ChildBitmap* bitmap) {
+	operator delete(bitmap);
+}
+
+PPMLanguageModel::ChildBitmap* PPMLanguageModel::ChildBitmap::copy(int newCapacity) const {
+	ChildBitmap* result = create(numOfSymbols, newCapacity);
+	result->numOfChildren=numOfChildren;
+	memcpy(result->getWords(), getWords(), sizeof(uint64_t)*getNumOfWords());
+	memcpy(result->getRanks(), getRanks(), sizeof(uint32_t)*getNumOfWords());
+	memcpy(result->getChildren(), getChildren(), sizeof(PPMNode*)*numOfChildren);
+	return result;
+}
+
+size_t PPMLanguageModel::ChildBitmap::getSize(int numOfSymbols, int capacity) {
+	int numOfWords = (numOfSymbols+63)>>6;
+	return sizeof(ChildBitmap)+sizeof(uint64_t)*numOfWords+sizeof(uint32_t)*((numOfWords+1)&~1)
+			+sizeof(PPMNode*)*capacity;
+}
+
+bool PPMLanguageModel::ChildBitmap::insert(PPMNode* child) {
+	if (numOfChildren==capacity) return false;
+	Symbol symbol = child->symbol;
+	uint64_t* words = getWords();
+	uint32_t* ranks = getRanks();
+	uint64_t bit = static_cast<uint64_t>(1)<<(symbol&63);
+	int index = ranks[symbol>>6]+__builtin_popcountll(words[symbol>>6]&(bit-1));
+	PPMNode** children = getChildren();
+	memmove(&children[index+1], &children[index], sizeof(PPMNode*)*(numOfChildren-index));
+	children[index]=child;
+	numOfChildren++;
+	words[symbol>>6]|=bit;
+	for (int i = (symbol>>6)+1; i<getNumOfWords(); i++) ranks[i]++;
+	return true;
+}
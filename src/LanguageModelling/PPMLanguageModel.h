@@ -4,8 +4,12 @@
 #include "../Common/DasherTypes.h"
 #include "../Common/PooledAllocator.h"
 #include <set>
+#include <stdint.h>
+#include <string>
 #include <vector>
 
+#define MAX_NUM_OF_SYMBOLS (1<<16) //getProbs gives every symbol at least 1 of its 1<<16
+
 namespace Dasher {
 	
 	//"Standard" PPM language model: getProbs uses counts in PPM child nodes.
@@ -14,31 +18,104 @@ namespace Dasher {
 	class PPMLanguageModel {
 		public:
 			typedef size_t Context; //Index of registered context
-			PPMLanguageModel(int numOfSymbols, int maxOrder);
+			//How nodes with many children (numOfSymbols/4 or more) store them
+			enum DenseChildStorage {
+				DIRECT_INDEXED_CHILDREN, //array of pointers indexed by symbol
+				BITMAP_RANKED_CHILDREN //presence bitmap plus packed array of children, see ChildBitmap
+			};
+			PPMLanguageModel(int numOfSymbols, int maxOrder, DenseChildStorage denseChildStorage = DIRECT_INDEXED_CHILDREN);
+			~PPMLanguageModel();
+			//Returns a deep copy of the model (with the same layout of child slots), allocated by the calling
+			//thread. Contexts are not copied.
+			PPMLanguageModel* clone() const;
 			Context createEmptyContext();
+			Context cloneContext(Context context);
 			void releaseContext(Context context);
 			void enterSymbol(Context context, Symbol symbol);
 			void learnSymbol(Context context, Symbol symbol);
 			void getProbs(Context context, std::vector<unsigned int>& probs, int alpha, int beta, int uniform) const;
+			//Distribution after entering 'contextSymbols' into an empty context. Uses no registered context,
+			//so it may be called from several threads at once (as long as no one is learning).
+			void getProbsAfter(const Symbol* contextSymbols, int length, std::vector<unsigned int>& probs,
+					int alpha, int beta, int uniform) const;
+			//Computes the distributions getProbs would return after entering each of 'childSymbols' into
+			//(a copy of) 'parent', i.e. expands a whole node at once. childProbs[i] belongs to childSymbols[i].
+			//Vine lookups and the counts of the root node are shared between all children. 'buffer' is scratch
+			//space, kept by the caller so that repeated expansions don't allocate; one per thread.
+			class ExpansionBuffer;
+			void getChildDistributions(Context parent, const std::vector<Symbol>& childSymbols,
+					std::vector<std::vector<unsigned int> >& childProbs, int alpha, int beta, int uniform,
+					ExpansionBuffer& buffer) const;
+			int getNumOfSymbols() const;
 			int getNumOfNodesAllocated() const;
+			size_t getMemoryUsage() const; //Bytes used by the nodes and their child arrays
+			//Saves the tree (not the contexts) to a binary snapshot file; returns false on failure
+			bool writeToFile(const std::string& fileName) const;
+			//Creates a model from a snapshot written by writeToFile; returns NULL on failure, including when
+			//the file is not a consistent tree (bad symbol numbers, counts, duplicate children or vines), and
+			//then sets 'error' (if not NULL) to a description of the problem
+			static PPMLanguageModel* readFromFile(const std::string& fileName,
+					DenseChildStorage denseChildStorage = DIRECT_INDEXED_CHILDREN, std::string* error = NULL);
+			//Renumbers the symbols inside the tree by how often they have been learned so far, most frequent
+			//first, and rebuilds all child arrays. Frequent symbols then share few hash slots and dense child
+			//arrays stay short. All public methods keep using the original symbol numbers.
+			void remapSymbolsByFrequency();
+			//Checks that 'other' holds the same tree: same symbols (in caller numbering), counts and vines
+			//for every node, whatever the layout of the child arrays. Also checks that findSymbol finds every
+			//child in both trees. For differential testing of alternative layouts and engines.
+			bool hasSameTree(const PPMLanguageModel& other) const;
+			class LayoutStats;
+			LayoutStats getLayoutStats() const;
+			//Statistics about the storage of child nodes, see getLayoutStats
+			class LayoutStats {
+				public:
+					int numOfNodesWithChildren;
+					int numOfDirectIndexedNodes; //nodes whose children use direct indexing
+					int numOfBitmapNodes; //nodes whose children use a ChildBitmap
+					size_t denseChildMemoryUsage; //bytes of the child arrays of the above two kinds of nodes
+					long long numOfChildren;
+					long long numOfProbes; //slots findSymbol reads to find every child once
+					int maxProbes; //for a single child
+					size_t memoryUsage; //see getMemoryUsage
+					LayoutStats() : numOfNodesWithChildren(0), numOfDirectIndexedNodes(0), numOfBitmapNodes(0),
+							denseChildMemoryUsage(0), numOfChildren(0), numOfProbes(0), maxProbes(0), memoryUsage(0) {
+						//empty
+					}
+					double getAverageProbes() const {
+						return numOfChildren==0 ? 0 : static_cast<double>(numOfProbes)/numOfChildren;
+					}
+			};
 		private:
 			class PPMNode;
+			class ChildBitmap;
 			class ChildIterator;
 			class PPMContext;
 			const int numOfSymbols; //The number of symbols over which we are making predictions
 			const int maxOrder;
+			const DenseChildStorage denseChildStorage;
 			PPMContext* rootContext;
 			PPMNode* root;
 			PooledAllocator<PPMContext> contextAllocator;
 			std::set<const PPMContext*> setOfContexts;
 			int numOfNodesAllocated;
 			PooledAllocator<PPMNode> nodeAllocator;
+			//Symbol numbers used in the tree (internal) for the numbers used by callers (external) and vice
+			//versa; the identity unless remapSymbolsByFrequency has been called
+			std::vector<Symbol> toInternal;
+			std::vector<Symbol> toExternal;
+			std::vector<unsigned int> symbolFrequencies; //times each (external) symbol has been learned
 			//disallow default copy-constructor and assignment operator
 			PPMLanguageModel(const PPMLanguageModel&);
 			PPMLanguageModel& operator=(const PPMLanguageModel&);
 			PPMNode* makeNode(Symbol symbol); //makes a standard PPMNode, but using a pooled
 			                                  //allocator (nodeAllocator) - faster!
 			PPMNode* addSymbolToNode(PPMNode* node, Symbol symbol);
+			void enterSymbol(PPMContext& context, Symbol symbol) const;
+			size_t getChildArrayMemoryUsage(const PPMNode* node) const; //of 'node' and all its descendants
+			//Fills 'probs' with the distribution of a context whose head is 'head' (the body of getProbs).
+			//'rootTotal' is the sum of the counts of the root's children, or -1 if the caller hasn't got it.
+			void getProbsAtNode(const PPMNode* head, int rootTotal, std::vector<unsigned int>& probs,
+					int alpha, int beta, int uniform) const;
 			class PPMNode {
 				public:
 					Symbol symbol;
@@ -50,19 +127,82 @@ namespace Dasher {
 					~PPMNode();
 					ChildIterator children() const;
 					const ChildIterator end() const;
-					void addChild(PPMNode* newChild, int numSymbols);
+					//useBitmap: store many children in a ChildBitmap instead of a direct indexed array
+					void addChild(PPMNode* newChild, int numSymbols, bool useBitmap);
+					//Stores 'allChildren' (of this node without a child array) in the smallest hash larger than
+					//'slots' that takes them in the given order, else in a direct indexed array (at least
+					//2*oldNumOfDirectElems long) or a ChildBitmap of the whole alphabet; may reorder 'allChildren'
+					void storeChildren(std::vector<PPMNode*>& allChildren, int slots, int oldNumOfDirectElems,
+							int numSymbols, bool useBitmap);
+					//Adds 'newChild' if that is possible without changing the kind of child storage (a
+					//ChildBitmap may grow its packed array), returns false otherwise
+					bool tryAddChild(PPMNode* newChild);
 					PPMNode* findSymbol(Symbol symbol) const;
+					//Gives this (childless) node copies of the children of 'other', in the same slots, with the
+					//same symbols and counts, allocated by 'model'. Vines of the copies are left NULL.
+					void copyChildrenFrom(const PPMNode& other, PPMLanguageModel& model);
+					int getChildArraySize() const; //Number of slots in 'childrenArray', 0 if there is none
+					size_t getChildArrayMemoryUsage() const; //Bytes of 'childrenArray' or 'bitmap'
+					//Changes the symbol of each child to newSymbols[symbol] and stores the children anew
+					void renumberChildren(const std::vector<Symbol>& newSymbols, int numSymbols, bool useBitmap);
+					void addLayoutStats(LayoutStats& stats) const;
+					static bool hasSmallerSymbol(const PPMNode* a, const PPMNode* b); //for sorting children
 				private:
 					//Elements in below array, including nulls, as follows:
-					// (a) negative -> absolute value is number of elems in 'childrenArray', but use direct indexing
+					// (a) negative -> absolute value is number of elems in 'childrenArray', but use direct indexing;
+					//     the array only extends up to the largest symbol of a child so far
 					// (b) 1 -> use 'child' as direct pointer to PPMNode (no array)
 					// (c) 2-MAX_RUN -> 'childrenArray' is unordered array of that many elems
 					// (d) >MAX_RUN -> 'childrenArray' is an inline hash (overflow to next elem) with that many slots
+					// (e) BITMAP_SLOTS -> use 'bitmap' where (a) would be used, if the model says so
 					int numOfChildSlots;
 					union {
 						PPMNode** childrenArray;
 						PPMNode* child;
+						ChildBitmap* bitmap;
 					};
+					void deleteChildArray();
+			};
+			//Children of a node stored in a single allocation: this header, one presence word per 64 symbols
+			//(bit s%64 of word s/64 is set if there is a child with symbol s), the number of children with
+			//smaller symbols than each word covers (its rank), and the children ordered by symbol without
+			//gaps. findSymbol adds the popcount of the lower bits of the symbol's word to the word's rank.
+			//This trades latency for memory: find makes three dependent loads (header, word, rank) before the
+			//child pointer, where a direct indexed array needs none, so entering symbols is slower. Iterating
+			//the packed array (getProbs) is about as fast as a direct array, faster for large alphabets.
+			class ChildBitmap {
+				public:
+					int numOfSymbols; //can store symbols 0...numOfSymbols-1, i.e. the whole alphabet, see storeChildren
+					int numOfChildren;
+					int capacity; //of the packed array
+					static ChildBitmap* create(int numOfSymbols, int capacity);
+					static void destroy(ChildBitmap* bitmap);
+					ChildBitmap* copy(int newCapacity) const; //the new capacity must hold all children
+					static size_t getSize(int numOfSymbols, int capacity); //bytes of the allocation
+					//Adds 'child' (with a symbol below numOfSymbols and not present yet); returns false if full
+					bool insert(PPMNode* child);
+					PPMNode* find(Symbol symbol) const {
+						if (symbol>=numOfSymbols) return NULL;
+						uint64_t word = getWords()[symbol>>6];
+						uint64_t bit = static_cast<uint64_t>(1)<<(symbol&63);
+						if ((word&bit)==0) return NULL;
+						return getChildren()[getRanks()[symbol>>6]+__builtin_popcountll(word&(bit-1))];
+					}
+					int getNumOfWords() const {
+						return (numOfSymbols+63)>>6;
+					}
+					uint64_t* getWords() const {
+						return (uint64_t*) (this+1);
+					}
+					uint32_t* getRanks() const {
+						return (uint32_t*) (getWords()+getNumOfWords());
+					}
+					PPMNode** getChildren() const { //after the ranks, rounded up to keep pointers aligned
+						return (PPMNode**) (getRanks()+((getNumOfWords()+1)&~1));
+					}
+				private:
+					int unused; //keeps the words 8 byte aligned
+					ChildBitmap(); //only allocated by create
 			};
 			class ChildIterator {
 				public:
@@ -94,6 +234,13 @@ namespace Dasher {
 					}
 			};
 	};
+	
+	//Scratch space of getChildDistributions (defined here, as it refers to the private PPMNode)
+	class PPMLanguageModel::ExpansionBuffer {
+		private:
+			friend class PPMLanguageModel;
+			std::vector<const PPMNode*> childHeads; //for each (internal) symbol, see getChildDistributions
+	};
 }
 
 #endif
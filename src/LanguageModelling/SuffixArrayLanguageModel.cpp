@@ -0,0 +1,301 @@
+#include "SuffixArrayLanguageModel.h"
+
+#include <algorithm>
+#include <stdint.h>
+
+#define NORMALIZATION (1<<16) //from CDasherModel
+#define MAX_UNINDEXED_LENGTH 4096 //symbols learned since the last rebuild that queries scan linearly
+
+using namespace Dasher;
+
+SuffixArrayLanguageModel::SuffixArrayLanguageModel(int numOfSymbols, int maxOrder) :
+		numOfSymbols(numOfSymbols), maxOrder(maxOrder), lastLearnContext(NULL), rootCounts(numOfSymbols+1, 0),
+		indexedLength(0), contextAllocator(1024) {
+	//empty
+}
+
+SuffixArrayLanguageModel::Context SuffixArrayLanguageModel::createEmptyContext() {
+	SAContext* allocatedContext = contextAllocator.allocate();
+	*allocatedContext=SAContext(); //may be a reused one
+	setOfContexts.insert(allocatedContext);
+	return (Context) allocatedContext;
+}
+
+SuffixArrayLanguageModel::Context SuffixArrayLanguageModel::cloneContext(Context context) {
+	SAContext* allocatedContext = contextAllocator.allocate();
+	*allocatedContext=*(SAContext*) context;
+	setOfContexts.insert(allocatedContext);
+	return (Context) allocatedContext;
+}
+
+void SuffixArrayLanguageModel::releaseContext(Context release) {
+	setOfContexts.erase(setOfContexts.find((SAContext*) release));
+	if (lastLearnContext==(SAContext*) release) lastLearnContext=NULL;
+	contextAllocator.free((SAContext*) release);
+}
+
+//Update context with symbol 'symbol'
+void SuffixArrayLanguageModel::enterSymbol(Context c, Symbol symbol) {
+	if (symbol==0) return;
+	//DASHER_ASSERT(symbol>=0 && symbol<=numOfSymbols);
+	ensureIndex();
+	SAContext& context = *(SAContext*) c;
+	refresh(context);
+	advance(context, symbol);
+	remember(context, symbol);
+}
+
+//Add symbol to the text, and leave 'context' at the new context
+void SuffixArrayLanguageModel::learnSymbol(Context c, Symbol symbol) {
+	if (symbol==0) return;
+	//DASHER_ASSERT(symbol>=0 && symbol<=numOfSymbols);
+	SAContext& context = *(SAContext*) c;
+	//Don't let matches run from one learning context into another
+	if (lastLearnContext!=&context && !text.empty()) {
+		text.push_back(0);
+		rootCounts[0]++;
+	}
+	lastLearnContext=&context;
+	//Move the context on as enterSymbol does, but without rebuilding the index: only matches in the text
+	//learned before count, so the pattern stays the longest suffix that occurs elsewhere and doesn't grow
+	//with the text at high orders
+	refresh(context);
+	advance(context, symbol);
+	remember(context, symbol);
+	text.push_back(symbol);
+	rootCounts[symbol]++;
+}
+
+//Get the probability distribution at the context
+void SuffixArrayLanguageModel::getProbs(Context context, std::vector<unsigned int>& probs, int alpha, int beta, int uniform) const {
+	//same blending as PPMLanguageModel::getProbs, with the vine chain replaced by successively shorter
+	//suffixes of the context's pattern, down to the empty context (the counts of the whole text)
+	int uniformAdd = std::max(1, NORMALIZATION*uniform/1000/numOfSymbols);
+	int norm = NORMALIZATION-numOfSymbols*uniformAdd; //non-uniform norm
+	//
+	ensureIndex();
+	const SAContext& saContext = *(const SAContext*) context;
+	refresh(saContext);
+	//Occurrences whose next symbol is in the unindexed tail: the symbols there preceded by the end of the
+	//context's history, with the length of that match (those preceded by none only count at the root),
+	//as length*(numOfSymbols+1)+symbol
+	std::vector<int> tailMatches;
+	int historyLength = getHistoryLength(saContext);
+	const Symbol* history = historyLength>0 ? &saContext.history[saContext.history.size()-historyLength] : NULL;
+	int maxDepth = saContext.pattern.size();
+	const Symbol* textSymbols = text.empty() ? NULL : &text[0];
+	for (int pos = std::max(indexedLength, 1); historyLength>0 && pos<(int) text.size(); pos++) {
+		if (textSymbols[pos]==0 || textSymbols[pos-1]!=history[historyLength-1]) continue; //0: end of a sequence
+		int length = 1;
+		while (length<historyLength && length<pos && textSymbols[pos-1-length]==history[historyLength-1-length])
+			length++;
+		tailMatches.push_back(length*(numOfSymbols+1)+textSymbols[pos]);
+		maxDepth=std::max(maxDepth, length);
+	}
+	if (!tailMatches.empty()) //taken from the back, longest matches first
+		std::sort(&tailMatches[0], &tailMatches[0]+tailMatches.size());
+	std::vector<int> tailCounts(numOfSymbols+1, 0); //of the tail matches at least as long as the depth
+	std::vector<Symbol> tailSymbols; //those with tailCounts>0
+	std::vector<int> listedAt(numOfSymbols+1, -1); //depth at which a symbol was last taken from the index
+	probs.assign(numOfSymbols+1, 0);
+	unsigned int toSpend = norm;
+	std::vector<Symbol> symbols;
+	std::vector<int> counts;
+	for (int depth = maxDepth; depth>=0; depth--) {
+		while (!tailMatches.empty() && tailMatches.back()/(numOfSymbols+1)>=depth) {
+			Symbol symbol = tailMatches.back()%(numOfSymbols+1);
+			if (tailCounts[symbol]++==0) tailSymbols.push_back(symbol);
+			tailMatches.pop_back();
+		}
+		symbols.clear();
+		counts.clear();
+		if (depth==0) { //empty context: the symbol counts of the whole text
+			for (Symbol symbol = 1; symbol<=numOfSymbols; symbol++) {
+				if (rootCounts[symbol]==0) continue;
+				symbols.push_back(symbol);
+				counts.push_back(rootCounts[symbol]);
+			}
+		} else {
+			if (depth<=(int) saContext.pattern.size()) {
+				int lo = saContext.intervals[depth].first, hi = saContext.intervals[depth].second;
+				//Suffixes in [lo, hi) are sorted by their next symbol, so each symbol is a contiguous run; skip
+				//those ending the indexed text (-1) or a sequence (0), which come first
+				for (int i = lowerBound(lo, hi, depth, 1), next; i<hi; i=next) {
+					Symbol symbol = symbolAt(i, depth);
+					next=lowerBound(i, hi, depth, symbol+1);
+					symbols.push_back(symbol);
+					counts.push_back(next-i+tailCounts[symbol]);
+					listedAt[symbol]=depth;
+				}
+			}
+			for (size_t i = 0; i<tailSymbols.size(); i++) {
+				if (listedAt[tailSymbols[i]]==depth) continue;
+				symbols.push_back(tailSymbols[i]);
+				counts.push_back(tailCounts[tailSymbols[i]]);
+			}
+		}
+		int64_t total = 0;
+		for (size_t i = 0; i<counts.size(); i++) total+=counts[i];
+		if (total!=0) {
+			unsigned int sizeOfSlice = toSpend;
+			for (size_t i = 0; i<symbols.size(); i++) {
+				unsigned int p = static_cast<int64_t>(sizeOfSlice)*(100*static_cast<int64_t>(counts[i])-beta)/(100*total+alpha);
+				probs[symbols[i]]+=p;
+				toSpend-=p;
+			}
+		}
+	}
+	unsigned int sizeOfSlice2 = toSpend;
+	for (int i = 1; i<=numOfSymbols; i++) {
+		unsigned int p = sizeOfSlice2/numOfSymbols;
+		probs[i]+=p;
+		toSpend-=p;
+	}
+	int left = numOfSymbols;
+	for (int i = 1; i<=numOfSymbols; i++) {
+		unsigned int p = toSpend/left;
+		probs[i]+=p+uniformAdd; //see PPMLanguageModel::getProbs
+		left--;
+		toSpend-=p;
+	}
+	//DASHER_ASSERT(toSpend==0);
+}
+
+int SuffixArrayLanguageModel::getLength() const {
+	return text.size();
+}
+
+size_t SuffixArrayLanguageModel::getMemoryUsage() const {
+	return text.capacity()*sizeof(Symbol)+suffixArray.capacity()*sizeof(int)+rootCounts.capacity()*sizeof(int);
+}
+
+void SuffixArrayLanguageModel::ensureIndex() const {
+	//Rebuilding costs O(n log n), so wait for a batch of new symbols; small texts are reindexed whenever
+	//they have doubled, so the cost stays O(log n) per symbol there
+	int numOfUnindexed = text.size()-indexedLength;
+	if (numOfUnindexed==0 || (numOfUnindexed<MAX_UNINDEXED_LENGTH && numOfUnindexed<=indexedLength)) return;
+	indexedLength=text.size();
+	buildSuffixArray();
+}
+
+void SuffixArrayLanguageModel::buildSuffixArray() const {
+	//Prefix doubling: after the round with length k, suffixes are sorted by their first 2k symbols,
+	//and rank[i] is the number of distinct such prefixes smaller than that of suffix i. Each round
+	//sorts by the pair (rank[i], rank[i+k]) using two stable counting sorts. A suffix shorter than
+	//the compared length sorts before all suffixes it is a prefix of.
+	int n = indexedLength;
+	suffixArray.assign(n, 0);
+	if (n==0) return;
+	std::vector<int> rank(n), temp(n);
+	std::vector<int> bucket(std::max(n, numOfSymbols+1)+1, 0);
+	for (int i = 0; i<n; i++) bucket[text[i]]++;
+	for (int i = 1; i<(int) bucket.size(); i++) bucket[i]+=bucket[i-1];
+	for (int i = n-1; i>=0; i--) suffixArray[--bucket[text[i]]]=i;
+	rank[suffixArray[0]]=0;
+	for (int i = 1; i<n; i++)
+		rank[suffixArray[i]]=rank[suffixArray[i-1]]+(text[suffixArray[i]]!=text[suffixArray[i-1]]);
+	for (int k = 1; rank[suffixArray[n-1]]<n-1; k<<=1) {
+		//order by second key: suffixes without one first, then by rank of the suffix k positions later
+		int pos = 0;
+		for (int i = std::max(0, n-k); i<n; i++) temp[pos++]=i;
+		for (int i = 0; i<n; i++)
+			if (suffixArray[i]>=k) temp[pos++]=suffixArray[i]-k;
+		//stable counting sort by first key
+		std::fill(bucket.begin(), bucket.end(), 0);
+		for (int i = 0; i<n; i++) bucket[rank[i]]++;
+		for (int i = 1; i<n; i++) bucket[i]+=bucket[i-1];
+		for (int i = n-1; i>=0; i--) suffixArray[--bucket[rank[temp[i]]]]=temp[i];
+		//new ranks
+		temp[suffixArray[0]]=0;
+		for (int i = 1; i<n; i++) {
+			int prev = suffixArray[i-1], cur = suffixArray[i];
+			bool same = rank[prev]==rank[cur] && (prev+k<n ? rank[prev+k] : -1)==(cur+k<n ? rank[cur+k] : -1);
+			temp[cur]=temp[prev]+(same ? 0 : 1);
+		}
+		rank.swap(temp);
+	}
+}
+
+Symbol SuffixArrayLanguageModel::symbolAt(int index, int depth) const {
+	int pos = suffixArray[index]+depth;
+	return pos<indexedLength ? text[pos] : -1;
+}
+
+int SuffixArrayLanguageModel::lowerBound(int lo, int hi, int depth, Symbol symbol) const {
+	//the next symbols of the suffixes in [lo, hi) are non-decreasing, so use binary search
+	int count = hi-lo;
+	while (count>0) {
+		int step = count/2;
+		if (symbolAt(lo+step, depth)<symbol) {
+			lo+=step+1;
+			count-=step+1;
+		} else count=step;
+	}
+	return lo;
+}
+
+bool SuffixArrayLanguageModel::narrow(int& lo, int& hi, int depth, Symbol symbol) const {
+	int first = lowerBound(lo, hi, depth, symbol);
+	if (first==hi || symbolAt(first, depth)!=symbol) return false;
+	hi=lowerBound(first, hi, depth, symbol+1);
+	lo=first;
+	return true;
+}
+
+//The suffixes starting with the last d+1 symbols of the new pattern are those starting with the last d
+//symbols of the old pattern followed by 'symbol', so each interval is narrowed from the next shorter one
+//instead of searching every suffix of the pattern from scratch
+void SuffixArrayLanguageModel::advance(const SAContext& context, Symbol symbol) const {
+	std::vector<std::pair<int, int> >& intervals = context.intervals;
+	int maxDepth = std::min((int) context.pattern.size(), maxOrder-1); //the new pattern must not be too long
+	std::pair<int, int> shorter = intervals[0]; //old interval of 'depth', before it is overwritten
+	int depth = 0;
+	for (; depth<=maxDepth; depth++) {
+		std::pair<int, int> interval = shorter;
+		if (depth+1<(int) intervals.size()) shorter=intervals[depth+1];
+		if (!narrow(interval.first, interval.second, depth, symbol)) break;
+		//a longer suffix followed by 'symbol' occurs only where the shorter ones do, so stop at the first miss
+		if (depth+1<(int) intervals.size()) intervals[depth+1]=interval;
+		else intervals.push_back(interval);
+	}
+	intervals.resize(depth+1);
+	context.pattern.push_back(symbol);
+	context.pattern.erase(context.pattern.begin(), context.pattern.end()-depth);
+}
+
+void SuffixArrayLanguageModel::refresh(const SAContext& context) const {
+	if (context.indexedLength==indexedLength) return;
+	//Symbols entered before the rebuild are still in the text, so entering them again finds at least the
+	//old pattern. A longer suffix of the history can only occur now where it is followed by a newly indexed
+	//symbol (it may start earlier); occurrences at the very end of the index can't be extended, so they
+	//don't count, which also keeps the learning context from matching all of its own history.
+	int length = context.pattern.size();
+	int historyLength = getHistoryLength(context);
+	const Symbol* history = historyLength>0 ? &context.history[context.history.size()-historyLength] : NULL;
+	const Symbol* textSymbols = text.empty() ? NULL : &text[0];
+	for (int pos = std::max(context.indexedLength, 1); historyLength>length && pos<indexedLength; pos++) {
+		if (textSymbols[pos]==0 || textSymbols[pos-1]!=history[historyLength-1]) continue;
+		int matched = 1;
+		while (matched<historyLength && matched<pos && textSymbols[pos-1-matched]==history[historyLength-1-matched])
+			matched++;
+		length=std::max(length, matched);
+	}
+	std::vector<Symbol> pattern;
+	if (length>(int) context.pattern.size()) pattern.assign(history+historyLength-length, history+historyLength);
+	else pattern.swap(context.pattern);
+	context.pattern.clear();
+	context.intervals.assign(1, std::make_pair(0, indexedLength));
+	for (size_t i = 0; i<pattern.size(); i++) advance(context, pattern[i]);
+	context.indexedLength=indexedLength;
+}
+
+void SuffixArrayLanguageModel::remember(SAContext& context, Symbol symbol) const {
+	int maxLength = std::min(maxOrder, MAX_UNINDEXED_LENGTH);
+	if ((int) context.history.size()>=2*maxLength) //drop the unused half at once, not one symbol per call
+		context.history.erase(context.history.begin(), context.history.end()-maxLength);
+	context.history.push_back(symbol);
+}
+
+int SuffixArrayLanguageModel::getHistoryLength(const SAContext& context) const {
+	return std::min((int) context.history.size(), std::min(maxOrder, MAX_UNINDEXED_LENGTH));
+}
@@ -0,0 +1,86 @@
+#ifndef SUFFIX_ARRAY_LANGUAGE_MODEL_INCLUDED
+#define SUFFIX_ARRAY_LANGUAGE_MODEL_INCLUDED
+
+#include "../Common/DasherTypes.h"
+#include "../Common/PooledAllocator.h"
+#include <set>
+#include <utility>
+#include <vector>
+
+namespace Dasher {
+
+	//PPM language model answering context counts from a suffix array over the learned symbol sequence
+	//instead of a tree of PPMNodes. Has the same interface as PPMLanguageModel, but its memory only
+	//depends on the length of the training text (8 bytes per symbol), not on maxOrder, so very high
+	//(PPM*-style, effectively unbounded) orders become affordable.
+	//Counts are plain occurrence counts, i.e. there is no update exclusion as in PPMLanguageModel, so
+	//predictions are similar but not identical to those of PPMLanguageModel with the same maxOrder.
+	//The suffix array is rebuilt lazily by the first query after MAX_UNINDEXED_LENGTH symbols (or more than
+	//were indexed before) have been learned, so learning a symbol and querying, as Dasher does, rebuilds at
+	//most once every 4096 symbols. Queries find the occurrences in the symbols learned since then (the
+	//unindexed tail) by a linear scan of its up to 4096 symbols, so what was just learned counts at once, as
+	//in PPMLanguageModel.
+	//A context keeps the longest suffix of its symbols that occurs elsewhere in the indexed text, plus the
+	//suffix array intervals of all suffixes of that, which entering a symbol narrows one by one, and its
+	//last symbols (at most maxOrder and MAX_UNINDEXED_LENGTH) for matching in the tail.
+	class SuffixArrayLanguageModel {
+		public:
+			typedef size_t Context; //Index of registered context
+			SuffixArrayLanguageModel(int numOfSymbols, int maxOrder);
+			Context createEmptyContext();
+			Context cloneContext(Context context);
+			void releaseContext(Context context);
+			void enterSymbol(Context context, Symbol symbol);
+			void learnSymbol(Context context, Symbol symbol);
+			void getProbs(Context context, std::vector<unsigned int>& probs, int alpha, int beta, int uniform) const;
+			int getLength() const; //Number of symbols learned so far (including sequence separators)
+			size_t getMemoryUsage() const; //Bytes used by the text and its index
+		private:
+			class SAContext;
+			const int numOfSymbols; //The number of symbols over which we are making predictions
+			const int maxOrder;
+			std::vector<Symbol> text; //All learned symbols; 0 separates sequences learned in different contexts
+			const SAContext* lastLearnContext; //Context of the last learnSymbol call (NULL if none)
+			std::vector<int> rootCounts; //Number of occurrences of every symbol in the text
+			//The index over the first indexedLength symbols of 'text', built lazily (hence mutable)
+			mutable std::vector<int> suffixArray; //Start positions of all indexed suffixes in sorted order
+			mutable int indexedLength; //grows with every rebuild, so it also tells stale contexts
+			PooledAllocator<SAContext> contextAllocator;
+			std::set<const SAContext*> setOfContexts;
+			//disallow default copy-constructor and assignment operator
+			SuffixArrayLanguageModel(const SuffixArrayLanguageModel&);
+			SuffixArrayLanguageModel& operator=(const SuffixArrayLanguageModel&);
+			void ensureIndex() const; //rebuilds the index if enough symbols have been learned since the last build
+			void buildSuffixArray() const; //prefix doubling with counting sort, O(n log n)
+			//Symbol following the suffix at suffixArray[index] after 'depth' symbols; -1 past the indexed text
+			Symbol symbolAt(int index, int depth) const;
+			//First index in [lo, hi) (of suffixes sharing a prefix of length 'depth') whose next symbol is
+			//not smaller than 'symbol', or hi if there is none
+			int lowerBound(int lo, int hi, int depth, Symbol symbol) const;
+			//Narrows the interval [lo, hi) of suffixes sharing a prefix of length 'depth' to those followed
+			//by 'symbol'. Returns false (leaving lo/hi untouched) if there are none.
+			bool narrow(int& lo, int& hi, int depth, Symbol symbol) const;
+			//Appends 'symbol' to the context's pattern and shortens that to its longest suffix found in the index
+			void advance(const SAContext& context, Symbol symbol) const;
+			//Re-enters the pattern of a stale context, longer if the rebuild added matches of its history
+			void refresh(const SAContext& context) const;
+			void remember(SAContext& context, Symbol symbol) const; //appends 'symbol' to the context's history
+			int getHistoryLength(const SAContext& context) const; //number of symbols of the history in use
+			class SAContext {
+				public:
+					//The longest suffix of the entered (or learned) symbols found in the indexed text
+					mutable std::vector<Symbol> pattern;
+					//intervals[d]: interval of the suffix array starting with the last d symbols of 'pattern'
+					mutable std::vector<std::pair<int, int> > intervals;
+					mutable int indexedLength; //of the index the intervals belong to, -1 for none yet
+					//The symbols entered (or learned); only the last getHistoryLength are used, older ones are
+					//dropped in batches
+					std::vector<Symbol> history;
+					SAContext() : indexedLength(-1) {
+						//empty
+					}
+			};
+	};
+}
+
+#endif
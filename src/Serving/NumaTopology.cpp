@@ -0,0 +1,87 @@
+#include "NumaTopology.h"
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE //for CPU_SET and pthread_setaffinity_np
+#endif
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+using namespace Dasher;
+
+NumaTopology NumaTopology::detect() {
+	NumaTopology topology;
+	for (int node = 0;; node++) {
+		char fileName[64];
+		snprintf(fileName, sizeof(fileName), "/sys/devices/system/node/node%d/cpulist", node);
+		FILE* file = fopen(fileName, "r");
+		if (file==NULL) break;
+		char list[4096];
+		std::vector<int> cpus;
+		if (fgets(list, sizeof(list), file)!=NULL) cpus=parseCpuList(list);
+		fclose(file);
+		if (!cpus.empty()) topology.cpusOfNode.push_back(cpus); //skip memory-only nodes
+	}
+	if (topology.cpusOfNode.empty()) topology.cpusOfNode.push_back(getAvailableCpus());
+	return topology;
+}
+
+NumaTopology NumaTopology::fake(int numOfNodes) {
+	NumaTopology topology;
+	std::vector<int> cpus = getAvailableCpus();
+	topology.cpusOfNode.resize(numOfNodes);
+	int numOfCpus = cpus.size();
+	for (int node = 0; node<numOfNodes; node++) {
+		if (numOfCpus<numOfNodes) {
+			topology.cpusOfNode[node].push_back(cpus[node%numOfCpus]);
+			continue;
+		}
+		for (int i = node*numOfCpus/numOfNodes; i<(node+1)*numOfCpus/numOfNodes; i++)
+			topology.cpusOfNode[node].push_back(cpus[i]);
+	}
+	return topology;
+}
+
+int NumaTopology::getNumOfNodes() const {
+	return cpusOfNode.size();
+}
+
+const std::vector<int>& NumaTopology::getCpus(int node) const {
+	return cpusOfNode[node];
+}
+
+bool NumaTopology::pinCurrentThread(int node) const {
+	cpu_set_t cpuSet;
+	CPU_ZERO(&cpuSet);
+	for (size_t i = 0; i<cpusOfNode[node].size(); i++)
+		CPU_SET(cpusOfNode[node][i], &cpuSet);
+	return pthread_setaffinity_np(pthread_self(), sizeof(cpuSet), &cpuSet)==0;
+}
+
+std::vector<int> NumaTopology::getAvailableCpus() {
+	std::vector<int> cpus;
+	cpu_set_t cpuSet;
+	CPU_ZERO(&cpuSet);
+	if (sched_getaffinity(0, sizeof(cpuSet), &cpuSet)==0) {
+		for (int cpu = 0; cpu<CPU_SETSIZE; cpu++)
+			if (CPU_ISSET(cpu, &cpuSet)) cpus.push_back(cpu);
+	}
+	if (cpus.empty()) cpus.push_back(0);
+	return cpus;
+}
+
+std::vector<int> NumaTopology::parseCpuList(const char* list) {
+	std::vector<int> cpus;
+	const char* pos = list;
+	while (*pos>='0' && *pos<='9') {
+		char* end;
+		int first = strtol(pos, &end, 10);
+		int last = first;
+		if (*end=='-') last=strtol(end+1, &end, 10);
+		for (int cpu = first; cpu<=last; cpu++) cpus.push_back(cpu);
+		pos=end;
+		if (*pos==',') pos++;
+	}
+	return cpus;
+}
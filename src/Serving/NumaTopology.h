@@ -0,0 +1,28 @@
+#ifndef NUMA_TOPOLOGY_INCLUDED
+#define NUMA_TOPOLOGY_INCLUDED
+
+#include <vector>
+
+namespace Dasher {
+
+	//The CPUs of the machine grouped by NUMA node (Linux only)
+	class NumaTopology {
+		public:
+			//Reads the topology from /sys/devices/system/node. Falls back to a single node containing all
+			//CPUs this process may run on if that isn't available.
+			static NumaTopology detect();
+			//Splits the CPUs this process may run on into 'numOfNodes' nodes of consecutive CPUs, to test
+			//NUMA-aware code on a single-socket machine. If there are fewer CPUs than nodes, nodes share CPUs.
+			static NumaTopology fake(int numOfNodes);
+			int getNumOfNodes() const;
+			const std::vector<int>& getCpus(int node) const;
+			//Restricts the calling thread to the CPUs of 'node'. Returns false if that failed.
+			bool pinCurrentThread(int node) const;
+		private:
+			std::vector<std::vector<int> > cpusOfNode;
+			static std::vector<int> getAvailableCpus();
+			static std::vector<int> parseCpuList(const char* list); //e.g. "0-3,8-11"
+	};
+}
+
+#endif
@@ -0,0 +1,151 @@
+#include "ReplicatedLanguageModel.h"
+
+#include <new>
+#include <stdexcept>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define CACHE_LINE_SIZE 64
+
+using namespace Dasher;
+
+static unsigned long long getNanos() {
+	timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec*1000000000ULL+now.tv_nsec;
+}
+
+ReplicatedLanguageModel::ReplicatedLanguageModel(const PPMLanguageModel& model, const NumaTopology& topology) :
+		topology(topology), replicas(topology.getNumOfNodes(), (PPMLanguageModel*) NULL),
+		nodeMetrics(topology.getNumOfNodes(), (LatencyMetrics*) NULL) {
+	int numOfNodes = topology.getNumOfNodes();
+	std::vector<pthread_t> threads(numOfNodes);
+	std::vector<ThreadArgs> args(numOfNodes);
+	int numOfThreads = 0;
+	for (int node = 0; node<numOfNodes; node++) {
+		args[node].model=this;
+		args[node].original=&model;
+		args[node].worker=NULL;
+		args[node].node=node;
+		args[node].index=0;
+		args[node].succeeded=false;
+		if (pthread_create(&threads[node], NULL, copyReplica, &args[node])!=0) break;
+		numOfThreads++;
+	}
+	bool succeeded = (numOfThreads==numOfNodes);
+	for (int node = 0; node<numOfThreads; node++) {
+		pthread_join(threads[node], NULL);
+		if (!args[node].succeeded) succeeded=false;
+	}
+	if (!succeeded) {
+		//the destructor won't run, so free what the threads that did start have allocated
+		deleteReplicas();
+		if (numOfThreads<numOfNodes) throw std::runtime_error("Could not start a thread to copy a replica");
+		throw std::bad_alloc();
+	}
+}
+
+ReplicatedLanguageModel::~ReplicatedLanguageModel() {
+	deleteReplicas();
+}
+
+void ReplicatedLanguageModel::deleteReplicas() {
+	for (size_t node = 0; node<replicas.size(); node++) {
+		delete replicas[node];
+		free(nodeMetrics[node]);
+	}
+}
+
+const NumaTopology& ReplicatedLanguageModel::getTopology() const {
+	return topology;
+}
+
+const PPMLanguageModel& ReplicatedLanguageModel::getReplica(int node) const {
+	return *replicas[node];
+}
+
+bool ReplicatedLanguageModel::serve(int threadsPerNode, Worker& worker) {
+	int numOfThreads = topology.getNumOfNodes()*threadsPerNode;
+	std::vector<pthread_t> threads(numOfThreads);
+	std::vector<ThreadArgs> args(numOfThreads);
+	int numOfStarted = 0;
+	for (int i = 0; i<numOfThreads; i++) {
+		args[i].model=this;
+		args[i].original=NULL;
+		args[i].worker=&worker;
+		args[i].node=i/threadsPerNode;
+		args[i].index=i%threadsPerNode;
+		args[i].succeeded=false;
+		if (pthread_create(&threads[i], NULL, runWorker, &args[i])!=0) break;
+		numOfStarted++;
+	}
+	for (int i = 0; i<numOfStarted; i++)
+		pthread_join(threads[i], NULL);
+	return numOfStarted==numOfThreads;
+}
+
+void ReplicatedLanguageModel::getProbs(int workerNode, int replicaNode, const std::vector<Symbol>& contextSymbols,
+		std::vector<unsigned int>& probs, int alpha, int beta, int uniform) {
+	unsigned long long start = getNanos();
+	//getProbsAfter uses an unregistered context on the stack, so the replica is only read
+	replicas[replicaNode]->getProbsAfter(contextSymbols.empty() ? NULL : &contextSymbols[0], contextSymbols.size(),
+			probs, alpha, beta, uniform);
+	unsigned long long nanos = getNanos()-start;
+	LatencyMetrics& metrics = *nodeMetrics[workerNode];
+	if (workerNode==replicaNode) {
+		__sync_fetch_and_add(&metrics.localQueries, 1ULL);
+		__sync_fetch_and_add(&metrics.localNanos, nanos);
+	} else {
+		__sync_fetch_and_add(&metrics.crossNodeQueries, 1ULL);
+		__sync_fetch_and_add(&metrics.crossNodeNanos, nanos);
+	}
+}
+
+ReplicatedLanguageModel::LatencyMetrics ReplicatedLanguageModel::getMetrics() const {
+	LatencyMetrics result;
+	for (size_t node = 0; node<nodeMetrics.size(); node++) {
+		LatencyMetrics* source = nodeMetrics[node];
+		result.localQueries+=__sync_fetch_and_add(&source->localQueries, 0ULL);
+		result.localNanos+=__sync_fetch_and_add(&source->localNanos, 0ULL);
+		result.crossNodeQueries+=__sync_fetch_and_add(&source->crossNodeQueries, 0ULL);
+		result.crossNodeNanos+=__sync_fetch_and_add(&source->crossNodeNanos, 0ULL);
+	}
+	return result;
+}
+
+void ReplicatedLanguageModel::resetMetrics() {
+	for (size_t node = 0; node<nodeMetrics.size(); node++) {
+		__sync_lock_test_and_set(&nodeMetrics[node]->localQueries, 0ULL);
+		__sync_lock_test_and_set(&nodeMetrics[node]->localNanos, 0ULL);
+		__sync_lock_test_and_set(&nodeMetrics[node]->crossNodeQueries, 0ULL);
+		__sync_lock_test_and_set(&nodeMetrics[node]->crossNodeNanos, 0ULL);
+	}
+}
+
+void* ReplicatedLanguageModel::copyReplica(void* args) {
+	ThreadArgs& threadArgs = *(ThreadArgs*) args;
+	if (!threadArgs.model->topology.pinCurrentThread(threadArgs.node))
+		printf("Could not pin thread to node %i, replica may not be local\n", threadArgs.node);
+	//an exception must not leave the start routine (that would terminate the program), so failures
+	//are left in 'succeeded' for the constructor to report
+	try {
+		threadArgs.model->replicas[threadArgs.node]=threadArgs.original->clone(); //first touch by this node
+	} catch (const std::bad_alloc&) {
+		return NULL;
+	}
+	//a whole cache line, so that counting queries on one node never invalidates another node's caches
+	void* memory = NULL;
+	if (posix_memalign(&memory, CACHE_LINE_SIZE, CACHE_LINE_SIZE)!=0) return NULL;
+	threadArgs.model->nodeMetrics[threadArgs.node]=new (memory) LatencyMetrics();
+	threadArgs.succeeded=true;
+	return NULL;
+}
+
+void* ReplicatedLanguageModel::runWorker(void* args) {
+	ThreadArgs& threadArgs = *(ThreadArgs*) args;
+	if (!threadArgs.model->topology.pinCurrentThread(threadArgs.node))
+		printf("Could not pin thread to node %i\n", threadArgs.node);
+	threadArgs.worker->run(*threadArgs.model, threadArgs.node, threadArgs.index);
+	return NULL;
+}
@@ -0,0 +1,86 @@
+#ifndef REPLICATED_LANGUAGE_MODEL_INCLUDED
+#define REPLICATED_LANGUAGE_MODEL_INCLUDED
+
+#include "../Common/DasherTypes.h"
+#include "../LanguageModelling/PPMLanguageModel.h"
+#include "NumaTopology.h"
+#include <pthread.h>
+#include <vector>
+
+namespace Dasher {
+
+	//Serves a trained (frozen) PPMLanguageModel from several threads on a multi-socket machine: keeps one
+	//replica of the model per NUMA node, each copied by a thread pinned to that node so that (with Linux'
+	//default first-touch policy) its nodes and child arrays live in that node's memory, and runs worker
+	//threads pinned to the nodes. Queries are timed and counted separately for workers using the replica
+	//of their own node (local) and of another node (cross-node). Queries take no locks, and each node's
+	//workers count into their own cache line, allocated on that node, so serving shares no written memory
+	//between nodes.
+	//Learning in the original model after construction is not reflected in the replicas.
+	class ReplicatedLanguageModel {
+		public:
+			class Worker;
+			class LatencyMetrics;
+			//Throws std::runtime_error if a thread to copy a replica can't be started, std::bad_alloc if a
+			//replica can't be allocated
+			ReplicatedLanguageModel(const PPMLanguageModel& model, const NumaTopology& topology);
+			~ReplicatedLanguageModel();
+			const NumaTopology& getTopology() const;
+			const PPMLanguageModel& getReplica(int node) const;
+			//Runs worker.run on 'threadsPerNode' threads pinned to each node and waits for all of them.
+			//Returns false if not all threads could be started (after waiting for those that were).
+			bool serve(int threadsPerNode, Worker& worker);
+			//Distribution after entering 'contextSymbols' into an empty context, computed on the replica of
+			//'replicaNode' with PPMLanguageModel::getProbsAfter. Thread-safe. 'workerNode' is the node the
+			//calling thread is pinned to.
+			void getProbs(int workerNode, int replicaNode, const std::vector<Symbol>& contextSymbols,
+					std::vector<unsigned int>& probs, int alpha, int beta, int uniform);
+			LatencyMetrics getMetrics() const; //sum over all nodes
+			void resetMetrics();
+			class Worker {
+				public:
+					virtual ~Worker() {
+						//empty
+					}
+					//Called on a thread pinned to 'node'; 'index' numbers the threads of that node
+					virtual void run(ReplicatedLanguageModel& model, int node, int index) = 0;
+			};
+			class LatencyMetrics {
+				public:
+					unsigned long long localQueries, crossNodeQueries;
+					unsigned long long localNanos, crossNodeNanos; //total time spent in these queries
+					LatencyMetrics() : localQueries(0), crossNodeQueries(0), localNanos(0), crossNodeNanos(0) {
+						//empty
+					}
+					double getAverageLocalMicros() const {
+						return localQueries==0 ? 0 : localNanos/1000.0/localQueries;
+					}
+					double getAverageCrossNodeMicros() const {
+						return crossNodeQueries==0 ? 0 : crossNodeNanos/1000.0/crossNodeQueries;
+					}
+			};
+		private:
+			class ThreadArgs;
+			const NumaTopology topology;
+			std::vector<PPMLanguageModel*> replicas; //one per node
+			//Queries of the workers on each node, updated atomically; each is alone in its cache line
+			std::vector<LatencyMetrics*> nodeMetrics;
+			//disallow default copy-constructor and assignment operator
+			ReplicatedLanguageModel(const ReplicatedLanguageModel&);
+			ReplicatedLanguageModel& operator=(const ReplicatedLanguageModel&);
+			void deleteReplicas();
+			static void* copyReplica(void* args);
+			static void* runWorker(void* args);
+			class ThreadArgs {
+				public:
+					ReplicatedLanguageModel* model;
+					const PPMLanguageModel* original;
+					Worker* worker;
+					int node;
+					int index;
+					bool succeeded; //set by copyReplica once the replica and its metrics are allocated
+			};
+	};
+}
+
+#endif
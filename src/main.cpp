@@ -1,9 +1,18 @@
 #include "LanguageModelling/PPMLanguageModel.h"
+#include "LanguageModelling/SuffixArrayLanguageModel.h"
+#include "Serving/ReplicatedLanguageModel.h"
 #include "Alphabet/SymbolStream.h"
 #include "Alphabet/AlphabetMap.h"
+#include "Alphabet/TokenMap.h"
 #include <vector>
 #include <fstream>
 #include <iostream>
+#include <ctime>
+#include <cstdlib>
+#include <cmath>
+#include <map>
+#include <sstream>
+#include <algorithm>
 
 using namespace Dasher;
 
@@ -98,8 +107,38 @@ AlphabetMap* getLargeAlphabetMap() {
 	return map;
 }
 
+//The same 62 characters as getLargeAlphabetMap, followed by 'nGrams' as symbols 63 and up
+TokenMap* getLargeTokenMap(const std::vector<std::string>& nGrams) {
+	TokenMap* map = new TokenMap();
+	std::string characters = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
+	for (size_t i = 0; i<characters.length(); i++) map->add(characters.substr(i, 1), i+1);
+	for (size_t i = 0; i<nGrams.size(); i++) map->add(nGrams[i], characters.length()+i+1);
+	return map;
+}
+
+//Returns the 'count' strings of 2 to 'maxLength' ASCII characters that save the most symbols when used as
+//tokens in 'text', estimated as (occurrences)*(length-1), ignoring overlaps
+std::vector<std::string> getFrequentNGrams(const std::string& text, size_t maxLength, size_t count) {
+	std::map<std::string, int> occurrences;
+	for (size_t i = 0; i<text.length(); i++) {
+		for (size_t length = 2; length<=maxLength && i+length<=text.length(); length++) {
+			if (static_cast<unsigned char>(text[i+length-1])>0x7f) break;
+			occurrences[text.substr(i, length)]++;
+		}
+	}
+	std::vector<std::pair<long long, std::string> > bySavings;
+	for (std::map<std::string, int>::const_iterator it = occurrences.begin(); it!=occurrences.end(); it++)
+		bySavings.push_back(std::make_pair(-static_cast<long long>(it->second)*(it->first.length()-1), it->first));
+	std::sort(bySavings.begin(), bySavings.end());
+	std::vector<std::string> nGrams;
+	for (size_t i = 0; i<count && i<bySavings.size(); i++) nGrams.push_back(bySavings[i].second);
+	return nGrams;
+}
+
 //adapted from CTrainer::Train
-void train(PPMLanguageModel* model, AlphabetMap* alphabetMap, SymbolStream& symbolStream) {
+//Map: AlphabetMap for one symbol per unicode character, or TokenMap for multi-character symbols
+template <typename Model, typename Map>
+void train(Model* model, Map* alphabetMap, SymbolStream& symbolStream) {
 	PPMLanguageModel::Context context = model->createEmptyContext();
 	for (Symbol symbol; (symbol=symbolStream.next(alphabetMap))!=-1;) {
 		model->learnSymbol(context, symbol);
@@ -107,6 +146,202 @@ void train(PPMLanguageModel* model, AlphabetMap* alphabetMap, SymbolStream& symb
 	model->releaseContext(context);
 }
 
+//Trains 'model' on the large training file and prints build time, memory usage and the average latency
+//of entering a few random symbols into a fresh context and calling getProbs
+template <typename Model>
+void benchmarkBackend(const char* name, Model* model, int numOfSymbols, int alpha, int beta, int uniform) {
+	AlphabetMap* alphabetMap = getLargeAlphabetMap();
+	std::ifstream trainingTextStream;
+	trainingTextStream.open("trainingLarge3.txt");
+	SymbolStream symStream(trainingTextStream);
+	std::vector<unsigned int> probs;
+	clock_t start = clock();
+	train(model, alphabetMap, symStream);
+	typename Model::Context context = model->createEmptyContext();
+	model->getProbs(context, probs, alpha, beta, uniform); //the suffix array is built on the first query
+	model->releaseContext(context);
+	clock_t middle = clock();
+	trainingTextStream.close();
+	delete alphabetMap;
+	const int numOfQueries = 10000;
+	srand(1);
+	for (int i = 0; i<numOfQueries; i++) {
+		context = model->createEmptyContext();
+		for (int j = 0; j<8; j++) model->enterSymbol(context, 1+rand()%numOfSymbols);
+		model->getProbs(context, probs, alpha, beta, uniform);
+		model->releaseContext(context);
+	}
+	clock_t stop = clock();
+	std::cout << name << ": build " << 1000.0*(middle-start)/CLOCKS_PER_SEC << " ms, memory "
+			<< model->getMemoryUsage()/1024 << " KiB, query " << 1e6*(stop-middle)/CLOCKS_PER_SEC/numOfQueries << " us\n";
+}
+
+void printLayoutStats(const PPMLanguageModel& model) {
+	PPMLanguageModel::LayoutStats stats = model.getLayoutStats();
+	std::cout << "Memory " << stats.memoryUsage/1024 << " KiB, " << stats.numOfNodesWithChildren
+			<< " nodes with children (" << stats.numOfDirectIndexedNodes << " direct indexed), probes per child: average "
+			<< stats.getAverageProbes() << ", max " << stats.maxProbes << "\n";
+}
+
+//Trains an order 'maxOrder' model on 'text', split into symbols by 'alphabetMap', then predicts the first
+//'predictionLength' bytes of it symbol by symbol (getProbs + enterSymbol, as Dasher does while writing).
+//Prints training and prediction throughput in characters of text and the bits spent per character.
+template <typename Map>
+void benchmarkTokenization(const char* name, Map* alphabetMap, int numOfSymbols, int maxOrder, const std::string& text,
+		size_t predictionLength, int alpha, int beta, int uniform) {
+	PPMLanguageModel model(numOfSymbols, maxOrder);
+	std::istringstream trainingTextStream(text);
+	SymbolStream symStream(trainingTextStream);
+	clock_t start = clock();
+	train(&model, alphabetMap, symStream);
+	clock_t middle = clock();
+	std::istringstream predictionTextStream(text.substr(0, predictionLength));
+	SymbolStream predictionStream(predictionTextStream);
+	PPMLanguageModel::Context context = model.createEmptyContext();
+	std::vector<unsigned int> probs;
+	double bits = 0;
+	int numOfPredictions = 0;
+	for (Symbol symbol; (symbol=predictionStream.next(alphabetMap))!=-1; numOfPredictions++) {
+		model.getProbs(context, probs, alpha, beta, uniform);
+		unsigned int total = 0;
+		for (size_t i = 0; i<probs.size(); i++) total+=probs[i];
+		bits-=log2(static_cast<double>(probs[symbol])/total);
+		model.enterSymbol(context, symbol);
+	}
+	model.releaseContext(context);
+	clock_t stop = clock();
+	double trainingSeconds = static_cast<double>(middle-start)/CLOCKS_PER_SEC;
+	double predictionSeconds = static_cast<double>(stop-middle)/CLOCKS_PER_SEC;
+	std::cout << name << " (" << numOfSymbols << " symbols, order " << maxOrder << "): train "
+			<< text.length()/1e6/trainingSeconds << " MB/s, " << model.getNumOfNodesAllocated() << " nodes, memory "
+			<< model.getMemoryUsage()/1024 << " KiB; predict " << predictionLength/1e3/predictionSeconds << " kB/s ("
+			<< static_cast<double>(predictionLength)/numOfPredictions << " chars per symbol), "
+			<< bits/predictionLength << " bits/char\n";
+}
+
+//Markov chain whose next symbol depends on the previous one and is Zipf distributed otherwise, as a
+//stand-in for training text over a large alphabet
+std::vector<Symbol> generateSymbolStream(int numOfSymbols, int length, unsigned int seed) {
+	std::vector<double> cumulative(numOfSymbols);
+	double sum = 0;
+	for (int i = 0; i<numOfSymbols; i++) cumulative[i]=(sum+=1.0/(i+1));
+	std::vector<Symbol> stream(length);
+	Symbol previous = 1;
+	for (int i = 0; i<length; i++) {
+		double r = rand_r(&seed)/(RAND_MAX+1.0)*sum;
+		int rank = std::upper_bound(cumulative.begin(), cumulative.end(), r)-cumulative.begin();
+		stream[i]=previous=1+(previous*7919+rank)%numOfSymbols;
+	}
+	return stream;
+}
+
+//Trains a model with direct indexed and one with bitmap ranked dense child arrays on 'stream', prints their
+//memory per node and per dense node and the latencies of entering 8 symbols (taken from the stream) into an
+//empty context and of getProbs there, and checks that both agree
+void benchmarkDenseChildStorage(int numOfSymbols, int maxOrder, const std::vector<Symbol>& stream,
+		int alpha, int beta, int uniform) {
+	PPMLanguageModel direct(numOfSymbols, maxOrder, PPMLanguageModel::DIRECT_INDEXED_CHILDREN);
+	PPMLanguageModel bitmap(numOfSymbols, maxOrder, PPMLanguageModel::BITMAP_RANKED_CHILDREN);
+	PPMLanguageModel* models[] = {&direct, &bitmap};
+	const char* names[] = {"Direct indexed", "Bitmap ranked"};
+	const int numOfQueries = 20000;
+	unsigned long long checksums[] = {0, 0};
+	for (int m = 0; m<2; m++) {
+		PPMLanguageModel* model = models[m];
+		clock_t start = clock();
+		PPMLanguageModel::Context context = model->createEmptyContext();
+		for (size_t i = 0; i<stream.size(); i++) model->learnSymbol(context, stream[i]);
+		model->releaseContext(context);
+		clock_t trained = clock();
+		std::vector<PPMLanguageModel::Context> contexts(numOfQueries);
+		unsigned int seed = 1;
+		for (int q = 0; q<numOfQueries; q++) {
+			contexts[q]=model->createEmptyContext();
+			size_t pos = rand_r(&seed)%(stream.size()-8);
+			for (int j = 0; j<8; j++) model->enterSymbol(contexts[q], stream[pos+j]);
+		}
+		clock_t entered = clock();
+		std::vector<unsigned int> probs;
+		for (int q = 0; q<numOfQueries; q++) {
+			model->getProbs(contexts[q], probs, alpha, beta, uniform);
+			for (size_t i = 0; i<probs.size(); i++) checksums[m]=checksums[m]*31+probs[i];
+		}
+		clock_t stop = clock();
+		for (int q = 0; q<numOfQueries; q++) model->releaseContext(contexts[q]);
+		PPMLanguageModel::LayoutStats stats = model->getLayoutStats();
+		int numOfDenseNodes = stats.numOfDirectIndexedNodes+stats.numOfBitmapNodes;
+		std::cout << names[m] << ": build " << 1000.0*(trained-start)/CLOCKS_PER_SEC << " ms, memory "
+				<< stats.memoryUsage/1024 << " KiB (" << static_cast<double>(stats.memoryUsage)/model->getNumOfNodesAllocated()
+				<< " bytes per node), " << numOfDenseNodes << " dense nodes with "
+				<< (numOfDenseNodes==0 ? 0 : stats.denseChildMemoryUsage/numOfDenseNodes) << " bytes of children each; enter "
+				<< 1e6*(entered-trained)/CLOCKS_PER_SEC/numOfQueries << " us, getProbs "
+				<< 1e6*(stop-entered)/CLOCKS_PER_SEC/numOfQueries << " us\n";
+	}
+	std::cout << "Same tree: " << (direct.hasSameTree(bitmap) ? "yes" : "NO") << ", same probabilities: "
+			<< (checksums[0]==checksums[1] ? "yes" : "NO") << "\n";
+}
+
+//Expands the node at 'context' into all of its children, once with a context per child (enterSymbol +
+//getProbs, as Dasher does it) and once with getChildDistributions, checks that both agree and prints timings
+void benchmarkNodeExpansion(PPMLanguageModel* model, PPMLanguageModel::Context context, int numOfSymbols,
+		int alpha, int beta, int uniform, int repetitions) {
+	std::vector<Symbol> childSymbols;
+	for (Symbol symbol = 1; symbol<=numOfSymbols; symbol++) childSymbols.push_back(symbol);
+	std::vector<std::vector<unsigned int> > perChild(numOfSymbols);
+	std::vector<std::vector<unsigned int> > shared;
+	PPMLanguageModel::ExpansionBuffer buffer;
+	clock_t start = clock();
+	for (int r = 0; r<repetitions; r++) {
+		for (int i = 0; i<numOfSymbols; i++) {
+			PPMLanguageModel::Context child = model->cloneContext(context);
+			model->enterSymbol(child, childSymbols[i]);
+			model->getProbs(child, perChild[i], alpha, beta, uniform);
+			model->releaseContext(child);
+		}
+	}
+	clock_t middle = clock();
+	for (int r = 0; r<repetitions; r++) {
+		model->getChildDistributions(context, childSymbols, shared, alpha, beta, uniform, buffer);
+	}
+	clock_t stop = clock();
+	std::cout << "Per-child: " << 1000.0*(middle-start)/CLOCKS_PER_SEC << " ms, shared: "
+			<< 1000.0*(stop-middle)/CLOCKS_PER_SEC << " ms (" << repetitions << " expansions of "
+			<< numOfSymbols << " children), results " << (perChild==shared ? "identical" : "DIFFER") << "\n";
+}
+
+//Queries random contexts; even-numbered threads use the replica of their own node, odd-numbered ones
+//the replica of the next node, to compare local and cross-node latency
+class RandomQueryWorker : public ReplicatedLanguageModel::Worker {
+	public:
+		RandomQueryWorker(int numOfSymbols, int numOfQueries) : numOfSymbols(numOfSymbols), numOfQueries(numOfQueries) {
+			//empty
+		}
+		void run(ReplicatedLanguageModel& model, int node, int index) {
+			int replicaNode = (index%2==0) ? node : (node+1)%model.getTopology().getNumOfNodes();
+			unsigned int seed = node*1000+index;
+			std::vector<Symbol> contextSymbols(8);
+			std::vector<unsigned int> probs;
+			for (int i = 0; i<numOfQueries; i++) {
+				for (size_t j = 0; j<contextSymbols.size(); j++) contextSymbols[j]=1+rand_r(&seed)%numOfSymbols;
+				model.getProbs(node, replicaNode, contextSymbols, probs, 49, 77, 80);
+			}
+		}
+	private:
+		int numOfSymbols;
+		int numOfQueries;
+};
+
+void benchmarkReplicatedServing(const char* name, const PPMLanguageModel& model, const NumaTopology& topology,
+		int numOfSymbols) {
+	ReplicatedLanguageModel replicated(model, topology);
+	RandomQueryWorker worker(numOfSymbols, 20000);
+	if (!replicated.serve(2, worker)) std::cout << name << ": could not start all worker threads\n";
+	ReplicatedLanguageModel::LatencyMetrics metrics = replicated.getMetrics();
+	std::cout << name << " (" << topology.getNumOfNodes() << " nodes): local " << metrics.localQueries
+			<< " queries, " << metrics.getAverageLocalMicros() << " us; cross-node " << metrics.crossNodeQueries
+			<< " queries, " << metrics.getAverageCrossNodeMicros() << " us\n";
+}
+
 int main() {
 	int alpha = 49;
 	int beta = 77;
@@ -190,7 +425,100 @@ int main() {
 	lmLarge.enterSymbol(context, 1);
 	lmLarge.getProbs(context, probs, alpha, beta, uniform);
 	printVector(probs);
+	
+	std::cout << "\nExpanding 'bdca' in small and large:\n";
+	PPMLanguageModel::Context smallContext = lm.createEmptyContext();
+	lm.enterSymbol(smallContext, 2);
+	lm.enterSymbol(smallContext, 4);
+	lm.enterSymbol(smallContext, 3);
+	lm.enterSymbol(smallContext, 1);
+	benchmarkNodeExpansion(&lm, smallContext, numOfSymbols, alpha, beta, uniform, 1);
+	lm.releaseContext(smallContext);
+	benchmarkNodeExpansion(&lmLarge, context, numOfSymbolsLarge, alpha, beta, uniform, 1000);
 	lmLarge.releaseContext(context);
 	
+	std::cout << "\nServing large from replicas:\n";
+	ReplicatedLanguageModel replicatedLarge(lmLarge, NumaTopology::fake(2));
+	std::vector<Symbol> contextSymbols;
+	contextSymbols.push_back(2);
+	contextSymbols.push_back(4);
+	contextSymbols.push_back(3);
+	contextSymbols.push_back(1);
+	std::vector<unsigned int> replicaProbs;
+	replicatedLarge.getProbs(0, 1, contextSymbols, replicaProbs, alpha, beta, uniform);
+	std::cout << "Replica agrees with original on 'bdca': " << (replicaProbs==probs ? "yes" : "NO") << ", size: "
+			<< (replicatedLarge.getReplica(1).getMemoryUsage()==lmLarge.getMemoryUsage() ? "yes" : "NO") << "\n";
+	benchmarkReplicatedServing("Detected topology", lmLarge, NumaTopology::detect(), numOfSymbolsLarge);
+	benchmarkReplicatedServing("Fake topology", lmLarge, NumaTopology::fake(2), numOfSymbolsLarge);
+	
+	std::cout << "\nRenumbering symbols of large by frequency:\n";
+	printLayoutStats(lmLarge);
+	lmLarge.remapSymbolsByFrequency();
+	printLayoutStats(lmLarge);
+	std::vector<unsigned int> remappedProbs;
+	context = lmLarge.createEmptyContext();
+	for (size_t i = 0; i<contextSymbols.size(); i++) lmLarge.enterSymbol(context, contextSymbols[i]);
+	lmLarge.getProbs(context, remappedProbs, alpha, beta, uniform);
+	std::cout << "Probabilities for 'bdca' unchanged: " << (remappedProbs==probs ? "yes" : "NO") << "\n";
+	benchmarkNodeExpansion(&lmLarge, context, numOfSymbolsLarge, alpha, beta, uniform, 1000);
+	lmLarge.releaseContext(context);
+	
+	std::cout << "\nSaving large to large.snapshot (can be served by DasherLMDaemon):\n";
+	bool written = lmLarge.writeToFile("large.snapshot");
+	PPMLanguageModel* lmLoaded = PPMLanguageModel::readFromFile("large.snapshot");
+	std::vector<unsigned int> loadedProbs;
+	if (lmLoaded!=NULL) lmLoaded->getProbsAfter(&contextSymbols[0], contextSymbols.size(), loadedProbs, alpha, beta, uniform);
+	std::cout << "Written: " << (written ? "yes" : "NO") << ", loaded: " << (lmLoaded!=NULL ? "yes" : "NO")
+			<< ", probabilities for 'bdca' unchanged: " << (loadedProbs==probs ? "yes" : "NO") << "\n";
+	delete lmLoaded;
+	
+	std::cout << "\nPer-character vs. multi-character symbols on large training file:\n";
+	std::ifstream textFileStream("trainingLarge3.txt");
+	std::stringstream textBuffer;
+	textBuffer << textFileStream.rdbuf();
+	std::string textLarge = textBuffer.str();
+	std::vector<std::string> nGrams = getFrequentNGrams(textLarge, 4, 64);
+	alphabetMapLarge = getLargeAlphabetMap();
+	TokenMap* tokenMapLarge = getLargeTokenMap(nGrams);
+	std::cout << "Tokens: 62 characters and " << nGrams.size() << " n-grams, most useful '" << nGrams[0]
+			<< "', '" << nGrams[1] << "', '" << nGrams[2] << "'\n";
+	benchmarkTokenization("Characters", alphabetMapLarge, numOfSymbolsLarge, 5, textLarge, 200000, alpha, beta, uniform);
+	TokenMap* characterTokenMapLarge = getLargeTokenMap(std::vector<std::string>());
+	benchmarkTokenization("Characters by TokenMap", characterTokenMapLarge, numOfSymbolsLarge, 5, textLarge, 200000,
+			alpha, beta, uniform);
+	delete characterTokenMapLarge;
+	int numOfTokensLarge = tokenMapLarge->getNumOfTokens();
+	benchmarkTokenization("Tokens", tokenMapLarge, numOfTokensLarge, 3, textLarge, 200000, alpha, beta, uniform);
+	benchmarkTokenization("Tokens", tokenMapLarge, numOfTokensLarge, 5, textLarge, 200000, alpha, beta, uniform);
+	delete tokenMapLarge;
+	delete alphabetMapLarge;
+	
+	std::cout << "\nDirect indexed vs. bitmap ranked children of dense nodes:\n";
+	std::vector<Symbol> streamLarge;
+	std::istringstream streamLargeText(textLarge);
+	SymbolStream symStreamLargeText(streamLargeText);
+	alphabetMapLarge = getLargeAlphabetMap();
+	for (Symbol symbol; (symbol=symStreamLargeText.next(alphabetMapLarge))!=-1;) streamLarge.push_back(symbol);
+	delete alphabetMapLarge;
+	std::cout << "62 symbols (large training file), order 5:\n";
+	benchmarkDenseChildStorage(numOfSymbolsLarge, 5, streamLarge, alpha, beta, uniform);
+	std::cout << "256 symbols (generated), order 4:\n";
+	benchmarkDenseChildStorage(256, 4, generateSymbolStream(256, 1000000, 1), alpha, beta, uniform);
+	std::cout << "4000 symbols (generated), order 3:\n";
+	benchmarkDenseChildStorage(4000, 3, generateSymbolStream(4000, 1000000, 1), alpha, beta, uniform);
+	
+	std::cout << "\nComparing PPM tree and suffix array on large training file:\n";
+	for (int order = 5; order<=8; order+=3) {
+		std::cout << "Order " << order << ":\n";
+		PPMLanguageModel* tree = new PPMLanguageModel(numOfSymbolsLarge, order);
+		benchmarkBackend("PPM tree", tree, numOfSymbolsLarge, alpha, beta, uniform);
+		delete tree;
+		SuffixArrayLanguageModel* suffixArray = new SuffixArrayLanguageModel(numOfSymbolsLarge, order);
+		benchmarkBackend("Suffix array", suffixArray, numOfSymbolsLarge, alpha, beta, uniform);
+		delete suffixArray;
+	}
+	SuffixArrayLanguageModel suffixArrayUnbounded(numOfSymbolsLarge, 1<<30);
+	benchmarkBackend("Suffix array, unbounded order", &suffixArrayUnbounded, numOfSymbolsLarge, alpha, beta, uniform);
+	
 	return 0;
 }